@@ -1,6 +1,7 @@
 #include <ncurses.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <chrono>
 #include <unistd.h>
@@ -8,6 +9,31 @@
 #include <stdint.h>
 #include <vector>
 #include <queue>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <new>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <math.h>
+#include <stddef.h>
 
 FILE* _log_file;
 
@@ -16,16 +42,164 @@ FILE* _log_file;
 // A maze game where you adventure a randomly generated maze, the entire maze will be gray #, until the player can see the area, then the walls will be a white # and the empty spaces will be a space.
 // the player will be a green @
 
-// the maze will be a list of integers, 8 bit integers representing 8 tiles of the maze.
-// the 8 tiles of an integer are always stacked horizontally, so the maze width must be a multiple of 8.
+// the maze is stored as bit planes, each plane is a list of 64 bit integers with one bit per tile.
+// which bit a tile maps to depends on the layout of the maze, see bitIndex.
+// a coordinate fits in an int, but a maze can have far more tiles than that, so anything counting tiles, bits or words is 64 bit.
 
+// how the bits of a maze plane (walls, explored, dead, navmap) are laid out in memory.
+// row major is the simplest, but moving vertically touches a new cache line every row.
+// tiled and morton keep each 8x8 block of tiles in a single uint64_t, so the vertical rays,
+// the up/down neighbor checks and the 3x3 reveal all stay inside one or two words.
+enum class Layout {
+    RowMajor, // bit y * width + x
+    Tiled,    // one uint64_t per 8x8 tile, tiles stored row by row
+    Morton,   // one uint64_t per 8x8 tile, tiles and the bits inside them stored in z-order
+};
+
+// memory accounting. every owning type reports what it allocates and frees here,
+// so long running processes can check nothing is growing
+enum MemLayer {
+    MEM_WALLS,
+    MEM_EXPLORED,
+    MEM_DEAD,
+    MEM_NAVMAP,
+    MEM_NAVIGATOR,
+    MEM_GENERATOR,
+    MEM_JOURNAL,
+    MEM_SPECTATORS,
+    MEM_GRAPH,
+    MEM_EXPORT,
+    MEM_BOTS,
+    MEM_LAYERS,
+};
+
+const char* MEM_LAYER_NAMES[MEM_LAYERS] = {"walls", "explored", "dead", "navmap", "navigator", "generator", "journal", "spectators", "graph", "export", "bots"};
+
+std::atomic<int64_t> _mem_layers[MEM_LAYERS];
+std::atomic<int64_t> _mem_total{0};
+std::atomic<int64_t> _mem_peak{0};
+
+void memAlloc(MemLayer layer, size_t bytes) {
+    _mem_layers[layer] += bytes;
+    int64_t total = _mem_total += bytes;
+    int64_t peak = _mem_peak;
+    while (total > peak && !_mem_peak.compare_exchange_weak(peak, total)) {}
+}
+
+void memFree(MemLayer layer, size_t bytes) {
+    _mem_layers[layer] -= bytes;
+    _mem_total -= bytes;
+}
+
+size_t memLayerBytes(MemLayer layer) {
+    return _mem_layers[layer];
+}
+
+size_t memTotalBytes() {
+    return _mem_total;
+}
+
+size_t memPeakBytes() {
+    return _mem_peak;
+}
+
+void logMemStats() {
+    for (int i = 0; i < MEM_LAYERS; i++) {
+        LOG("%-10s %zu bytes\n", MEM_LAYER_NAMES[i], memLayerBytes((MemLayer)i));
+    }
+    LOG("total      %zu bytes, peak %zu bytes\n", memTotalBytes(), memPeakBytes());
+}
+
+// which blocks of DIRTY_BLOCK words of the explored and dead planes changed since they were last taken, so the journal and the
+// spectators only compare those instead of whole planes. a bit per block, and a bit per 64 blocks over that, so taking them
+// costs about as much as what changed. bits can be marked from several threads at once, but are only taken while nothing marks
+const int DIRTY_BLOCK_SHIFT = 6;
+const size_t DIRTY_BLOCK = (size_t)1 << DIRTY_BLOCK_SHIFT;
+
+struct DirtyWords {
+    std::vector<uint64_t> blocks;
+    std::vector<uint64_t> groups;
+    MemLayer layer = MEM_JOURNAL;
+
+    DirtyWords() = default;
+    DirtyWords(const DirtyWords&) = delete;
+    DirtyWords& operator=(const DirtyWords&) = delete;
+    ~DirtyWords() {
+        memFree(layer, (blocks.capacity() + groups.capacity()) * sizeof(uint64_t));
+    }
+};
+
+void initDirty(DirtyWords* dirty, size_t words, MemLayer layer) {
+    memFree(dirty->layer, (dirty->blocks.capacity() + dirty->groups.capacity()) * sizeof(uint64_t));
+    size_t blocks = (words + DIRTY_BLOCK - 1) >> DIRTY_BLOCK_SHIFT;
+    dirty->blocks.assign((blocks + 63) / 64, 0);
+    dirty->groups.assign((dirty->blocks.size() + 63) / 64, 0);
+    dirty->layer = layer;
+    memAlloc(layer, (dirty->blocks.capacity() + dirty->groups.capacity()) * sizeof(uint64_t));
+}
+
+void freeDirty(DirtyWords* dirty) {
+    memFree(dirty->layer, (dirty->blocks.capacity() + dirty->groups.capacity()) * sizeof(uint64_t));
+    std::vector<uint64_t>().swap(dirty->blocks);
+    std::vector<uint64_t>().swap(dirty->groups);
+}
+
+inline void markBlock(DirtyWords* dirty, size_t block) {
+    uint64_t bit = (uint64_t)1 << (block % 64);
+    // most writes land in a block that is already marked, so look before writing
+    if ((__atomic_load_n(&dirty->blocks[block / 64], __ATOMIC_RELAXED) & bit) == 0) {
+        __atomic_fetch_or(&dirty->blocks[block / 64], bit, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&dirty->groups[block / 4096], (uint64_t)1 << (block / 64 % 64), __ATOMIC_RELAXED);
+    }
+}
+
+// calls take(block) for every marked block, and clears them
+template <typename Take>
+void takeDirty(DirtyWords* dirty, Take take) {
+    for (size_t g = 0; g < dirty->groups.size(); g++) {
+        uint64_t group = dirty->groups[g];
+        dirty->groups[g] = 0;
+        while (group != 0) {
+            size_t b = g * 64 + __builtin_ctzll(group);
+            group &= group - 1;
+            uint64_t blocks = dirty->blocks[b];
+            dirty->blocks[b] = 0;
+            while (blocks != 0) {
+                take(b * 64 + __builtin_ctzll(blocks));
+                blocks &= blocks - 1;
+            }
+        }
+    }
+}
+
+// a maze owns its walls, explored and dead planes, which are one allocation.
+// it can be moved but not copied, pass it by reference
 struct Maze {
-    int* maze;
-    int* explored;
-    int width;
-    int height;
-    int* navmap=nullptr;
-    int* dead=nullptr;
+    uint64_t* maze = nullptr;
+    uint64_t* explored = nullptr;
+    int width = 0;
+    int height = 0;
+    uint64_t* navmap = nullptr; // not owned, points at the navigator's path
+    uint64_t* dead = nullptr;
+    DirtyWords* dirty = nullptr; // not owned, marks what changes in explored and dead if something wants to know
+    Layout layout = Layout::RowMajor;
+    size_t words = 0; // number of uint64_t in each plane
+    // endless mazes only keep a window of rows [top, height) in a ring of rows, rowmask maps a row to its place in the ring.
+    // a normal maze keeps all of its rows, rowmask is then all ones
+    int top = 0;
+    int rows = 0;
+    int rowmask = -1;
+    std::unique_ptr<uint64_t[]> storage;
+
+    Maze() = default;
+    Maze(int width, int height, Layout layout, int rows = 0);
+    Maze(Maze&& other) {
+        *this = std::move(other);
+    }
+    Maze& operator=(Maze&& other);
+    Maze(const Maze&) = delete;
+    Maze& operator=(const Maze&) = delete;
+    ~Maze();
 };
 
 struct Player {
@@ -34,10 +208,67 @@ struct Player {
 };
 
 
+// the direction of every cell from the generator, packed 2 bits per cell in one block.
+// each row starts on a new word so the conversion can read a row of cells a word at a time.
+// a direction is stored as dir - 1, and the origin (which has no direction) is kept on its own
+const uint64_t DIR_LANES = 0x5555555555555555ull; // the low bit of every 2 bit cell
+const int CELLS_PER_WORD = 32;
+
 struct MazeGenRes {
-    uint8_t** maze;
-    int width;
-    int height;
+    std::unique_ptr<uint64_t[]> cells;
+    int width = 0;
+    int height = 0;
+    size_t rowwords = 0;
+    Player origin = {0, 0};
+
+    MazeGenRes() = default;
+    // if the allocation fails cells is left null
+    MazeGenRes(int width, int height)
+        : width(width), height(height), rowwords((width + CELLS_PER_WORD - 1) / CELLS_PER_WORD) {
+        cells.reset(new (std::nothrow) uint64_t[rowwords * height]());
+        if (cells != nullptr) {
+            memAlloc(MEM_GENERATOR, bytes());
+        }
+    }
+    MazeGenRes(MazeGenRes&& other) {
+        *this = std::move(other);
+    }
+    MazeGenRes& operator=(MazeGenRes&& other) {
+        if (cells != nullptr) {
+            memFree(MEM_GENERATOR, bytes());
+        }
+        cells = std::move(other.cells);
+        width = other.width;
+        height = other.height;
+        rowwords = other.rowwords;
+        origin = other.origin;
+        other.width = 0;
+        other.height = 0;
+        other.rowwords = 0;
+        return *this;
+    }
+    ~MazeGenRes() {
+        if (cells != nullptr) {
+            memFree(MEM_GENERATOR, bytes());
+        }
+    }
+
+    size_t bytes() const {
+        return rowwords * height * sizeof(uint64_t);
+    }
+
+    // 0 for the origin, otherwise 1 = right, 2 = up (-y), 3 = left, 4 = down (+y)
+    uint8_t at(int x, int y) const {
+        if (x == origin.x && y == origin.y) {
+            return 0;
+        }
+        return ((cells[y * rowwords + x / CELLS_PER_WORD] >> (x % CELLS_PER_WORD * 2)) & 3) + 1;
+    }
+    void set(int x, int y, uint8_t dir) {
+        uint64_t& word = cells[y * rowwords + x / CELLS_PER_WORD];
+        int shift = x % CELLS_PER_WORD * 2;
+        word = (word & ~((uint64_t)3 << shift)) | ((uint64_t)(dir - 1) << shift);
+    }
 };
 
 struct Camera {
@@ -45,147 +276,668 @@ struct Camera {
     int yoffset;
 };
 
-void displayMaze(Maze maze, Player player, Camera* cam, Player nav={-1, -1}, bool checkexplore = true);
+// spread the low 32 bits of v out so there is a zero bit between each of them
+inline uint64_t spreadBits(uint64_t v) {
+    v &= 0xFFFFFFFF;
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
 
-Maze convMazeNoEx(MazeGenRes res) {
-    int width = (res.width+1) * 2;
-    int height = (res.height+1) * 2;
-    int* maze = new int[width * height / 8];
+inline uint64_t mortonIndex(uint32_t x, uint32_t y) {
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// the morton layout cuts the grid of 8x8 tiles into blocks of MORTON_BLOCK x MORTON_BLOCK tiles, stored row by row,
+// and z-orders the tiles inside each block. a block is a power of two square so it can be indexed with mortonIndex,
+// but the maze is only padded up to whole blocks, so a long thin maze costs about what it does row major
+const int MORTON_BLOCK_SHIFT = 4;
+const int MORTON_BLOCK = 1 << MORTON_BLOCK_SHIFT; // 16x16 tiles, 2 KB of words covering 128x128 cells
+
+// blocks across a row of the maze
+inline size_t mortonBlocks(int cells) {
+    return ((size_t)(cells + 7) / 8 + MORTON_BLOCK - 1) >> MORTON_BLOCK_SHIFT;
+}
+
+// the word holding tile (tx, ty), tiles being 8x8 cells
+inline size_t mortonWord(int width, uint32_t tx, uint32_t ty) {
+    size_t block = (size_t)(ty >> MORTON_BLOCK_SHIFT) * mortonBlocks(width) + (tx >> MORTON_BLOCK_SHIFT);
+    return (block << (MORTON_BLOCK_SHIFT * 2)) + mortonIndex(tx & (MORTON_BLOCK - 1), ty & (MORTON_BLOCK - 1));
+}
+
+size_t planeWords(Layout layout, int width, int height) {
+    switch (layout) {
+        case Layout::Tiled:
+            return (size_t)((width + 7) / 8) * ((height + 7) / 8);
+        case Layout::Morton:
+            return mortonBlocks(width) * mortonBlocks(height) << (MORTON_BLOCK_SHIFT * 2);
+        case Layout::RowMajor:
+        default:
+            return ((size_t)width * height + 63) / 64;
+    }
+}
+
+const char* layoutName(Layout layout) {
+    switch (layout) {
+        case Layout::Tiled: return "tiled";
+        case Layout::Morton: return "morton";
+        case Layout::RowMajor:
+        default: return "rowmajor";
+    }
+}
+
+// every access to a plane goes through here, so the layout can be swapped without touching the game logic
+inline size_t bitIndex(const Maze& maze, int x, int y) {
+    y &= maze.rowmask;
+    switch (maze.layout) {
+        case Layout::Tiled: {
+            size_t tile = (size_t)(y >> 3) * ((maze.width + 7) >> 3) + (x >> 3);
+            return tile * 64 + ((y & 7) << 3) + (x & 7);
+        }
+        case Layout::Morton: {
+            size_t tile = mortonWord(maze.width, x >> 3, y >> 3);
+            return tile * 64 + mortonIndex(x & 7, y & 7);
+        }
+        case Layout::RowMajor:
+        default:
+            return (size_t)y * maze.width + x;
+    }
+}
+
+inline bool getBit(const Maze& maze, const uint64_t* plane, int x, int y) {
+    size_t i = bitIndex(maze, x, y);
+    return (plane[i / 64] >> (i % 64)) & 1;
+}
+
+inline void markDirty(const Maze& maze, const uint64_t* plane, size_t word) {
+    if (maze.dirty != nullptr && (plane == maze.explored || plane == maze.dead)) {
+        markBlock(maze.dirty, word >> DIRTY_BLOCK_SHIFT);
+    }
+}
+
+// the game thread is the only one writing a plane while the game runs, but an export may be reading it on its own thread.
+// so words are loaded and stored relaxed: still a plain load, or and store, just never torn or merged with other writes
+inline void setBit(const Maze& maze, uint64_t* plane, int x, int y) {
+    size_t i = bitIndex(maze, x, y);
+    uint64_t* word = &plane[i / 64];
+    __atomic_store_n(word, __atomic_load_n(word, __ATOMIC_RELAXED) | (uint64_t)1 << (i % 64), __ATOMIC_RELAXED);
+    markDirty(maze, plane, i / 64);
+}
+
+inline void clearBit(const Maze& maze, uint64_t* plane, int x, int y) {
+    size_t i = bitIndex(maze, x, y);
+    uint64_t* word = &plane[i / 64];
+    __atomic_store_n(word, __atomic_load_n(word, __ATOMIC_RELAXED) & ~((uint64_t)1 << (i % 64)), __ATOMIC_RELAXED);
+    markDirty(maze, plane, i / 64);
+}
+
+// padding bits are never set, so counting the set cells of a plane is just a popcount over its words
+size_t countBits(const Maze& maze, const uint64_t* plane) {
+    size_t count = 0;
+    for (size_t i = 0; i < maze.words; i++) {
+        count += __builtin_popcountll(plane[i]);
+    }
+    return count;
+}
+
+Maze::Maze(int width, int height, Layout layout, int rows)
+    : width(width), height(height), layout(layout), rows(rows == 0 ? height : rows) {
+    words = planeWords(layout, width, this->rows);
+    storage.reset(new (std::nothrow) uint64_t[words * 3]());
+    if (storage == nullptr) {
+        // out of memory, the maze is left empty and the caller has to check storage
+        words = 0;
+        return;
+    }
+    maze = storage.get();
+    explored = maze + words;
+    dead = explored + words;
+    memAlloc(MEM_WALLS, words * sizeof(uint64_t));
+    memAlloc(MEM_EXPLORED, words * sizeof(uint64_t));
+    memAlloc(MEM_DEAD, words * sizeof(uint64_t));
+}
+
+Maze& Maze::operator=(Maze&& other) {
+    if (storage != nullptr) {
+        memFree(MEM_WALLS, words * sizeof(uint64_t));
+        memFree(MEM_EXPLORED, words * sizeof(uint64_t));
+        memFree(MEM_DEAD, words * sizeof(uint64_t));
+    }
+    storage = std::move(other.storage);
+    maze = other.maze;
+    explored = other.explored;
+    dead = other.dead;
+    navmap = other.navmap;
+    dirty = other.dirty;
+    width = other.width;
+    height = other.height;
+    layout = other.layout;
+    words = other.words;
+    top = other.top;
+    rows = other.rows;
+    rowmask = other.rowmask;
+    other.maze = other.explored = other.dead = other.navmap = nullptr;
+    other.dirty = nullptr;
+    other.words = 0;
+    return *this;
+}
+
+Maze::~Maze() {
+    if (storage != nullptr) {
+        memFree(MEM_WALLS, words * sizeof(uint64_t));
+        memFree(MEM_EXPLORED, words * sizeof(uint64_t));
+        memFree(MEM_DEAD, words * sizeof(uint64_t));
+    }
+}
+
+void displayMaze(const Maze& maze, Player player, Camera* cam, Player nav={-1, -1}, bool checkexplore = true);
 
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            int tile = 1;
-            if (x % 2 == 1 && y % 2 == 1 && x < width - 1 && y < height - 1) {
-                tile = 0;
+// the conversion builds whole rows of wall tiles from the packed directions and stores them a word (or a tile byte) at a time.
+// a row of tiles is a list of words, bit x of the row is tile x, bits past the width are zero
+
+// masks for 8 tiles in a line inside a tile word, indexed by a byte with a bit per tile.
+// a row of 8 (bit x is tile x) is a byte of a tiled word, mortonrow spreads it to where row 0 of a morton word keeps it.
+// a column of 8 (bit y is tile y) goes through tiledcolumn or mortoncolumn to land in column 0.
+// other rows and columns are a shift away
+struct TileMasks {
+    uint64_t mortonrow[256];
+    uint64_t mortoncolumn[256];
+    uint64_t tiledcolumn[256];
+    TileMasks() {
+        for (int b = 0; b < 256; b++) {
+            mortonrow[b] = mortoncolumn[b] = tiledcolumn[b] = 0;
+            for (int i = 0; i < 8; i++) {
+                if (b & (1 << i)) {
+                    mortonrow[b] |= (uint64_t)1 << mortonIndex(i, 0);
+                    mortoncolumn[b] |= (uint64_t)1 << mortonIndex(0, i);
+                    tiledcolumn[b] |= (uint64_t)1 << (i * 8);
+                }
             }
-            
-            maze[(y * width + x) / 8] = (maze[(y * width + x) / 8] & ~(1 << ((y * width + x) % 8))) | (tile << ((y * width + x) % 8));
         }
     }
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            if (x % 2 == 1 && y % 2 == 1 && x < width - 1 && y < height - 1) {
-                uint8_t direction = res.maze[y / 2][x / 2];
-                
-                int newx = x + (direction == 1) - (direction == 3);
-                int newy = y + (direction == 4) - (direction == 2);
+};
+const TileMasks TILE_MASKS;
 
-                if (newx >= 0 && newx < width && newy >= 0 && newy < height) {
-                    maze[(newy * width + newx) / 8] = (maze[(newy * width + newx) / 8] & ~(1 << ((newy * width + newx) % 8))) | (0 << ((newy * width + newx) % 8));
+// ors a row of tiles into the walls of row y
+void storeWallRow(Maze* maze, int y, const uint64_t* row) {
+    int width = maze->width;
+    switch (maze->layout) {
+        case Layout::Tiled:
+        case Layout::Morton: {
+            // every 8 tiles of the row are one byte of a tile word
+            size_t tilesx = (width + 7) >> 3;
+            size_t tiley = y >> 3;
+            int shift = maze->layout == Layout::Tiled ? (y & 7) * 8 : spreadBits(y & 7) << 1;
+            for (size_t c = 0; c < tilesx; c++) {
+                uint64_t byte = (row[c / 8] >> (c % 8 * 8)) & 0xFF;
+                if (byte == 0) {
+                    continue;
+                }
+                if (maze->layout == Layout::Tiled) {
+                    maze->maze[tiley * tilesx + c] |= byte << shift;
+                } else {
+                    maze->maze[mortonWord(width, c, tiley)] |= TILE_MASKS.mortonrow[byte] << shift;
+                }
+            }
+            break;
+        }
+        case Layout::RowMajor:
+        default: {
+            // the row starts part way into a word, so each word of it is split over two
+            size_t start = (size_t)y * width;
+            size_t words = (width + 63) / 64;
+            for (size_t k = 0; k < words; k++) {
+                size_t bit = start + k * 64;
+                uint64_t* dest = maze->maze + bit / 64;
+                dest[0] |= row[k] << (bit % 64);
+                if (bit % 64 != 0 && (row[k] >> (64 - bit % 64)) != 0) {
+                    dest[1] |= row[k] >> (64 - bit % 64);
                 }
             }
+            break;
         }
     }
+}
 
-    return {maze, nullptr, width, height};
+// the 2 bit cells of word k of row y, split into one mask per direction with a bit at the bottom of each cell that goes that way
+struct DirMasks {
+    uint64_t right;
+    uint64_t up;
+    uint64_t left;
+    uint64_t down;
+};
+
+inline DirMasks dirMasks(const MazeGenRes& res, int y, size_t k) {
+    if (y >= res.height || k >= res.rowwords) {
+        return {0, 0, 0, 0};
+    }
+    uint64_t word = res.cells[y * res.rowwords + k];
+    uint64_t lo = word & DIR_LANES;
+    uint64_t hi = (word >> 1) & DIR_LANES;
+    DirMasks masks = {~lo & ~hi & DIR_LANES, lo & ~hi, ~lo & hi, lo & hi};
+    // the origin doesn't go anywhere, and cells past the width don't exist
+    uint64_t keep = DIR_LANES;
+    if (y == res.origin.y && (size_t)res.origin.x / CELLS_PER_WORD == k) {
+        keep &= ~((uint64_t)1 << (res.origin.x % CELLS_PER_WORD * 2));
+    }
+    if (k == res.rowwords - 1 && res.width % CELLS_PER_WORD != 0) {
+        keep &= ((uint64_t)1 << (res.width % CELLS_PER_WORD * 2)) - 1;
+    }
+    masks.right &= keep;
+    masks.up &= keep;
+    masks.left &= keep;
+    masks.down &= keep;
+    return masks;
 }
 
-MazeGenRes mazeGen(int width, int height) {
-    // origin shift algorithm
-    // each cell is a direction
-    uint8_t** maze = new uint8_t*[width];
-    for (int i = 0; i < width; i++) {
-        maze[i] = new uint8_t[height];
+// finishes a row of tiles built from cell words: shifts it one tile right (tile 0 is the outer wall),
+// walls off the last two tiles and clears everything past the width
+void finishWallRow(uint64_t* row, size_t words, int width) {
+    uint64_t carry = 1;
+    for (size_t k = 0; k < words; k++) {
+        uint64_t next = row[k] >> 63;
+        row[k] = (row[k] << 1) | carry;
+        carry = next;
+    }
+    row[(width - 2) / 64] |= (uint64_t)1 << ((width - 2) % 64);
+    row[(width - 1) / 64] |= (uint64_t)1 << ((width - 1) % 64);
+    if (width % 64 != 0) {
+        row[width / 64] &= ((uint64_t)1 << (width % 64)) - 1;
     }
+    for (size_t k = (width + 63) / 64; k < words; k++) {
+        row[k] = 0;
+    }
+}
 
-    // every cell until the last column points right, then all the cells in the last column point down except the last one on the bottom which is the origin
-    // 0 = origin, 1 = right, 2 = down, 3 = left, 4 = up
+// writes the walls of res into out->maze, which has to be allocated already.
+// cell (cx, cy) is tile (2cx + 1, 2cy + 1), the tiles between cells are open where either cell points at the other
+void convMazeInto(const MazeGenRes& res, Maze* out) {
+    int width = out->width;
+    size_t words = (width + 63) / 64;
+    // one word of cells is 64 tiles, the last word of a row can spill into one more once shifted by the outer wall
+    std::vector<uint64_t> row(std::max(words, res.rowwords + 1));
 
-    Player origin = {width - 1, height - 1};
+    memset(out->maze, 0, out->words * sizeof(uint64_t));
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            if (x == width - 1 && y == height - 1) {
-                maze[y][x] = 0;
-            } else if (x == width - 1) {
-                maze[y][x] = 2;
-            } else {
-                maze[y][x] = 1;
-            }
+    std::fill(row.begin(), row.end(), ~(uint64_t)0);
+    if (width % 64 != 0) {
+        row[width / 64] = ((uint64_t)1 << (width % 64)) - 1;
+    }
+    std::fill(row.begin() + words, row.end(), 0);
+    storeWallRow(out, 0, row.data());
+    storeWallRow(out, out->height - 1, row.data());
+
+    for (int cy = 0; cy < res.height; cy++) {
+        // the row through the cells. a cell is open, the tile to its right is open if it points right or its neighbor points left
+        for (size_t k = 0; k < res.rowwords; k++) {
+            DirMasks masks = dirMasks(res, cy, k);
+            uint64_t nextleft = dirMasks(res, cy, k + 1).left;
+            uint64_t east = masks.right | (masks.left >> 2) | (nextleft << 62);
+            row[k] = (~east & DIR_LANES) << 1;
+        }
+        std::fill(row.begin() + res.rowwords, row.end(), 0);
+        finishWallRow(row.data(), row.size(), width);
+        storeWallRow(out, cy * 2 + 1, row.data());
+
+        // the row of walls below, the tile under a cell is open if it points down or the cell below points up
+        for (size_t k = 0; k < res.rowwords; k++) {
+            uint64_t south = dirMasks(res, cy, k).down | dirMasks(res, cy + 1, k).up;
+            row[k] = (~south & DIR_LANES) | (DIR_LANES << 1);
         }
+        std::fill(row.begin() + res.rowwords, row.end(), 0);
+        finishWallRow(row.data(), row.size(), width);
+        storeWallRow(out, cy * 2 + 2, row.data());
     }
+}
 
-    Camera cam = {0, 0};
+Maze convMazeNoEx(const MazeGenRes& res, Layout layout = Layout::RowMajor) {
+    int width = (res.width+1) * 2;
+    int height = (res.height+1) * 2;
+    Maze out(width, height, layout);
+    convMazeInto(res, &out);
+    return out;
+}
+
+// the generation animation. the generator thread converts the maze into the back buffer every frame and swaps it to the front,
+// the ui thread draws whatever is in the front. neither waits for the other: if the ui is still drawing, the generator skips that frame
+struct GenPreview {
+    Maze frames[2];
+    Player origins[2];
+    int front = 0;
+    bool fresh = false;
+    std::mutex lock; // held by the ui while it draws the front, and by the generator while it swaps
+};
+
+const int PREVIEW_FPS = 30;
+
+// every step of origin shift keeps the maze perfect, more steps just make it more random.
+// the steps are scaled with the number of cells so big mazes get mixed as well as small ones
+const uint64_t ORIGIN_SHIFT_MIN_ITERS = 1000000;
+const uint64_t ORIGIN_SHIFT_ITERS_PER_CELL = 16;
 
-    int num_iters = 1000000;
-    int num_display = 500;
-    int disp_iter = num_iters / num_display;
+// the preview converts the whole maze every frame, past this many cells generation isn't animated
+const size_t PREVIEW_MAX_CELLS = 1 << 20;
+
+void originShift(MazeGenRes* res, Player origin, uint64_t num_iters, GenPreview* preview) {
+    int width = res->width;
+    int height = res->height;
+
+    std::chrono::steady_clock::time_point lastframe = std::chrono::steady_clock::now();
+    // every step needs a random direction, and rand() for each was most of what generating cost. so they come from an xorshift,
+    // 32 directions per draw, seeded from rand() so a seed still gives the same maze every time
+    uint64_t state = ((uint64_t)rand() << 32 | (uint32_t)rand()) | 1;
+    uint64_t bits = 0;
+    int left = 0;
     // pick a random direction to go from the origin (make sure we don't go out of bounds)
-    for (int i = 0; i < num_iters; i++) {
-        // int dir = rand() % 4;
-        int dir = (rand() % 4) + 1;
+    uint64_t i = 0;
+    while (i < num_iters) {
+        if (left == 0) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            bits = state;
+            left = 32;
+        }
+        int dir = (bits & 3) + 1;
+        bits >>= 2;
+        left--;
         int newx = origin.x + (dir == 1) - (dir == 3);
         int newy = origin.y + (dir == 4) - (dir == 2);
         // bound check
         if (newx >= width || newx < 0 || newy >= height || newy < 0) {
-            i--;
             continue;
         }
         
-        maze[origin.y][origin.x] = dir;
+        res->set(origin.x, origin.y, dir);
         origin.x = newx;
         origin.y = newy;
-        maze[origin.y][origin.x] = 0;
+        res->origin = origin;
+        i++;
 
-        if (i % disp_iter == 0) {
-            Maze mazeobj = convMazeNoEx({maze, width, height});
-            Player player = {origin.x * 2, origin.y * 2};
-            displayMaze(mazeobj, player, &cam, {-1, -1}, false);
-            refresh();
+        // only look at the clock every so often, it costs more than a step
+        if (preview != nullptr && i % 1024 == 0) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now - lastframe < std::chrono::microseconds(1000000 / PREVIEW_FPS)) {
+                continue;
+            }
+            lastframe = now;
+            int back = 1 - preview->front;
+            convMazeInto(*res, &preview->frames[back]);
+            preview->origins[back] = {origin.x * 2, origin.y * 2};
+            if (preview->lock.try_lock()) {
+                preview->front = back;
+                preview->fresh = true;
+                preview->lock.unlock();
+            }
         }
     }
-
-    return {maze, width, height};
 }
 
+// fills res, which has to be allocated already
+void mazeGen(MazeGenRes* out, bool animate = true) {
+    // origin shift algorithm
+    // each cell is a direction
+    MazeGenRes& res = *out;
+    int width = res.width;
+    int height = res.height;
+
+    // every cell until the last column points right, then all the cells in the last column point down except the last one on the bottom which is the origin
+    // 0 = origin, 1 = right, 2 = up (-y), 3 = left, 4 = down (+y)
+
+    Player origin = {width - 1, height - 1};
+    res.origin = origin;
 
-Maze generateMaze(int width, int height) {
-    if (width % 8 != 0) {
-        printf("Width must be a multiple of 8, got %d\n", width);
-        return {nullptr, 0, 0};
+    // right is stored as 0, so that is just clearing the cells
+    memset(res.cells.get(), 0, res.bytes());
+    for (int y = 0; y < height; y++) {
+        res.set(width - 1, y, 4);
     }
 
-    int* maze = new int[width * height / 8];
-    int* explorered = new int[width * height / 8];
+    uint64_t num_iters = std::max(ORIGIN_SHIFT_MIN_ITERS, (uint64_t)width * height * ORIGIN_SHIFT_ITERS_PER_CELL);
+
+    if (!animate) {
+        originShift(&res, origin, num_iters, nullptr);
+        return;
+    }
 
-    for (int i = 0; i < width * height / 8; i++) {
-        explorered[i] = 0;
+    GenPreview preview;
+    for (Maze& frame : preview.frames) {
+        frame = Maze((width + 1) * 2, (height + 1) * 2, Layout::RowMajor);
     }
 
-    MazeGenRes realMaze = mazeGen(width/2 - 1, height/2 - 1);
+    std::atomic<bool> done{false};
+    std::thread generator([&]() {
+        originShift(&res, origin, num_iters, &preview);
+        done = true;
+    });
 
-    // start with a full wall maze, then mepty each cell, and its respective neighbor from its direction.
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            int tile = 1;
-            if (x % 2 == 1 && y % 2 == 1 && x < width - 1 && y < height - 1) {
-                tile = 0;
+    Camera cam = {0, 0};
+    while (!done) {
+        {
+            std::lock_guard<std::mutex> guard(preview.lock);
+            if (preview.fresh) {
+                preview.fresh = false;
+                displayMaze(preview.frames[preview.front], preview.origins[preview.front], &cam, {-1, -1}, false);
             }
-            
-            maze[(y * width + x) / 8] = (maze[(y * width + x) / 8] & ~(1 << ((y * width + x) % 8))) | (tile << ((y * width + x) % 8));
         }
+        refresh();
+        usleep(1000000 / PREVIEW_FPS / 2);
+    }
+    generator.join();
+}
+
+
+// origin shift only makes perfect mazes (exactly one path between any two cells).
+// braiding knocks a wall out of a fraction of the dead ends, which adds loops and so multiple paths.
+void braidMaze(Maze* maze, double braid) {
+    if (braid <= 0) {
+        return;
     }
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            if (x % 2 == 1 && y % 2 == 1 && x < width - 1 && y < height - 1) {
-                uint8_t direction = realMaze.maze[y / 2][x / 2];
-                
-                int newx = x + (direction == 1) - (direction == 3);
-                int newy = y + (direction == 4) - (direction == 2);
+    const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for (int y = 1; y < maze->height - 1; y += 2) {
+        for (int x = 1; x < maze->width - 1; x += 2) {
+            if (getBit(*maze, maze->maze, x, y)) {
+                continue;
+            }
+            int numempty = 0;
+            for (int d = 0; d < 4; d++) {
+                if (!getBit(*maze, maze->maze, x + dirs[d][0], y + dirs[d][1])) numempty++;
+            }
+            if (numempty != 1 || rand() >= braid * ((double)RAND_MAX + 1)) {
+                continue;
+            }
 
-                if (newx >= 0 && newx < width && newy >= 0 && newy < height) {
-                    maze[(newy * width + newx) / 8] = (maze[(newy * width + newx) / 8] & ~(1 << ((newy * width + newx) % 8))) | (0 << ((newy * width + newx) % 8));
+            // knock out a random wall that leads to another cell (not the outer wall)
+            int start = rand() % 4;
+            for (int i = 0; i < 4; i++) {
+                int d = (start + i) % 4;
+                int wx = x + dirs[d][0];
+                int wy = y + dirs[d][1];
+                int cx = x + dirs[d][0] * 2;
+                int cy = y + dirs[d][1] * 2;
+                if (cx < 1 || cx >= maze->width - 1 || cy < 1 || cy >= maze->height - 1 || getBit(*maze, maze->maze, cx, cy)) {
+                    continue;
+                }
+                if (getBit(*maze, maze->maze, wx, wy)) {
+                    clearBit(*maze, maze->maze, wx, wy);
+                    break;
                 }
             }
         }
     }
+}
+
+// the smallest and largest width or height of a maze. odd sizes are rounded down, the maze is always a whole number of cells
+const int MIN_MAZE_SIDE = 6;
+const int MAX_MAZE_SIDE = 1 << 30;
+
+// returns an empty maze (no storage) if it doesn't fit in memory
+Maze generateMaze(int width, int height, Layout layout = Layout::RowMajor, double braid = 0, bool animate = true) {
+    // both the maze and the generator are allocated before any work is done, so running out of memory is reported straight away
+    MazeGenRes realMaze(width/2 - 1, height/2 - 1);
+    Maze maze((realMaze.width + 1) * 2, (realMaze.height + 1) * 2, layout);
+    if (realMaze.cells == nullptr || maze.storage == nullptr) {
+        LOG("Not enough memory for a %dx%d maze\n", width, height);
+        return Maze();
+    }
+
+    mazeGen(&realMaze, animate && (size_t)realMaze.width * realMaze.height <= PREVIEW_MAX_CELLS);
+
+    // start with a full wall maze, then mepty each cell, and its respective neighbor from its direction.
+    convMazeInto(realMaze, &maze);
+    braidMaze(&maze, braid);
 
-    return {maze, explorered, width, height};
+    return maze;
     
 }
 
 
-void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkexplore) {
+// endless mode streams the maze in a row at a time with eller's algorithm, which only needs to remember the current row.
+// rows are written into a ring of ENDLESS_ROWS rows just ahead of the player, and the oldest rows are dropped to make room,
+// so memory stays the same however far down the player goes.
+const int ENDLESS_ROWS = 256;     // rows kept in memory, a power of two
+const int ENDLESS_LOOKAHEAD = 96; // rows generated below the player
+
+struct EllerState {
+    int cells;                // cells in a row
+    std::vector<int> set;     // which set each cell of the current row is in, cells in the same set are connected
+    std::vector<uint8_t> down; // cells of the current row that connect to the row below
+    std::vector<int> seen;    // scratch space indexed by set
+    std::vector<int> pick;
+    size_t accounted = 0;     // bytes of the vectors above reported to the memory accounting
+
+    EllerState() = default;
+    EllerState(const EllerState&) = delete;
+    EllerState& operator=(const EllerState&) = delete;
+    ~EllerState() {
+        memFree(MEM_GENERATOR, accounted);
+    }
+};
+
+void clearRow(Maze* maze, int y) {
+    for (int x = 0; x < maze->width; x++) {
+        clearBit(*maze, maze->maze, x, y);
+        clearBit(*maze, maze->explored, x, y);
+        clearBit(*maze, maze->dead, x, y);
+    }
+}
+
+// start a new row at the bottom of the window, dropping the top row if the ring is full
+void pushRow(Maze* maze) {
+    int y = maze->height;
+    if (y - maze->top >= maze->rows) {
+        maze->top = y - maze->rows + 1;
+    }
+    clearRow(maze, y);
+    for (int x = 0; x < maze->width; x++) {
+        setBit(*maze, maze->maze, x, y);
+    }
+    maze->height++;
+}
+
+// eller's algorithm, one row of cells and the row of walls below it
+void generateEndlessRow(EllerState* endless, Maze* maze) {
+    int cells = endless->cells;
+
+    // the row of cells, neighbors in different sets are randomly joined
+    pushRow(maze);
+    int y = maze->height - 1;
+    for (int c = 0; c < cells; c++) {
+        clearBit(*maze, maze->maze, c * 2 + 1, y);
+    }
+    for (int c = 0; c < cells - 1; c++) {
+        if (endless->set[c] == endless->set[c + 1] || rand() % 2 == 0) {
+            continue;
+        }
+        clearBit(*maze, maze->maze, c * 2 + 2, y);
+        int from = endless->set[c + 1];
+        for (int k = 0; k < cells; k++) {
+            if (endless->set[k] == from) {
+                endless->set[k] = endless->set[c];
+            }
+        }
+    }
+
+    // the row of walls below, every set has to go down at least once or it would be cut off
+    pushRow(maze);
+    y = maze->height - 1;
+    std::fill(endless->seen.begin(), endless->seen.end(), 0);
+    for (int c = 0; c < cells; c++) {
+        endless->down[c] = rand() % 2;
+        if (endless->down[c]) {
+            endless->seen[endless->set[c]] = -1;
+        }
+    }
+    for (int c = 0; c < cells; c++) {
+        // pick a random cell of each set that isn't going down yet
+        int id = endless->set[c];
+        if (endless->seen[id] >= 0 && rand() % ++endless->seen[id] == 0) {
+            endless->pick[id] = c;
+        }
+    }
+    for (int id = 0; id < cells; id++) {
+        if (endless->seen[id] > 0) {
+            endless->down[endless->pick[id]] = 1;
+        }
+    }
+    for (int c = 0; c < cells; c++) {
+        if (endless->down[c]) {
+            clearBit(*maze, maze->maze, c * 2 + 1, y);
+        }
+    }
+
+    // cells that didn't go down start the next row in a set of their own
+    std::fill(endless->seen.begin(), endless->seen.end(), 0);
+    for (int c = 0; c < cells; c++) {
+        if (endless->down[c]) {
+            endless->seen[endless->set[c]] = 1;
+        }
+    }
+    int nextid = 0;
+    for (int c = 0; c < cells; c++) {
+        if (!endless->down[c]) {
+            while (endless->seen[nextid]) nextid++;
+            endless->set[c] = nextid++;
+        }
+    }
+}
+
+Maze generateEndless(EllerState* endless, int width, Layout layout = Layout::RowMajor) {
+    Maze maze(width, 0, layout, ENDLESS_ROWS);
+    if (maze.storage == nullptr) {
+        return maze;
+    }
+    maze.rowmask = ENDLESS_ROWS - 1;
+
+    endless->cells = width / 2 - 1;
+    endless->set.resize(endless->cells);
+    for (int c = 0; c < endless->cells; c++) {
+        endless->set[c] = c;
+    }
+    endless->down.resize(endless->cells);
+    endless->seen.resize(endless->cells);
+    endless->pick.resize(endless->cells);
+    memFree(MEM_GENERATOR, endless->accounted);
+    endless->accounted = (endless->set.capacity() + endless->seen.capacity() + endless->pick.capacity()) * sizeof(int) + endless->down.capacity();
+    memAlloc(MEM_GENERATOR, endless->accounted);
+
+    // the top wall
+    pushRow(&maze);
+    return maze;
+}
+
+// make sure the maze goes at least to row y
+void advanceEndless(EllerState* endless, Maze* maze, int y) {
+    while (maze->height <= y) {
+        generateEndlessRow(endless, maze);
+    }
+}
+
+
+void displayMaze(const Maze& maze, Player player, Camera* cam, Player nav, bool checkexplore) {
     // keep the player in the center, unless the player is near the edge of the screen
     int scrwidth, scrheight;
     getmaxyx(stdscr, scrheight, scrwidth);
@@ -218,11 +970,11 @@ void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkex
         }
     }
 
-    if (maze.height < scrheight) {
-        cam->yoffset = 0;
+    if (maze.height - maze.top < scrheight) {
+        cam->yoffset = maze.top;
     } else {
-        if (pl.y < scrheight / 2) {
-            cam->yoffset = 0;
+        if (pl.y < maze.top + scrheight / 2) {
+            cam->yoffset = maze.top;
         } else if (pl.y > maze.height - scrheight / 2) {
             cam->yoffset = maze.height - scrheight + 1;
         } else {
@@ -238,7 +990,7 @@ void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkex
             int realx = x + cam->xoffset;
             int realy = y + cam->yoffset;
 
-            if (realx < 0 || realx >= maze.width-1 || realy < 0 || realy >= maze.height-1) {
+            if (realx < 0 || realx >= maze.width-1 || realy < maze.top || realy >= maze.height-1) {
                 mvaddch(y, x * 2, ' ');
                 mvaddch(y, x * 2 + 1, ' ');
                 continue;
@@ -260,16 +1012,14 @@ void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkex
                 continue;
             }
 
-            int tile = maze.maze[(realy * maze.width + realx) / 8];
-            // int explored = maze.explored[(realy * maze.width + realx) / 8];
-            int explored = 0;
+            bool tile = getBit(maze, maze.maze, realx, realy);
+            bool explored = false;
             if (checkexplore) {
-                explored = maze.explored[(realy * maze.width + realx) / 8];
+                explored = getBit(maze, maze.explored, realx, realy);
             }
-            int bit = (realy * maze.width + realx) % 8;
 
-            if (!checkexplore || explored & (1 << bit)) {
-                if (tile & (1 << bit)) {
+            if (!checkexplore || explored) {
+                if (tile) {
                     attron(COLOR_PAIR(1));
                     mvaddch(y, x * 2, 'M');
                     mvaddch(y, x * 2 + 1, 'M');
@@ -278,17 +1028,13 @@ void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkex
                     // mvaddch(y, x * 2, ' ');
                     // mvaddch(y, x * 2 + 1, ' ');
                     if (maze.navmap != nullptr) {
-                        int navtile = maze.navmap[(realy * maze.width + realx) / 8];
-                        int navbit = (realy * maze.width + realx) % 8;
-                        if (navtile & (1 << navbit)) {
+                        if (getBit(maze, maze.navmap, realx, realy)) {
                             attron(COLOR_PAIR(4));
                             mvaddch(y, x * 2, 'o');
                             mvaddch(y, x * 2 + 1, 'o');
                             attroff(COLOR_PAIR(4));
                         } else {
-                            int deadtile = maze.dead[(realy * maze.width + realx) / 8];
-                            int deadbit = (realy * maze.width + realx) % 8;
-                            if (deadtile & (1 << deadbit)) {
+                            if (getBit(maze, maze.dead, realx, realy)) {
                                 attron(COLOR_PAIR(5));
                                 mvaddch(y, x * 2, 'X');
                                 mvaddch(y, x * 2 + 1, 'X');
@@ -299,14 +1045,12 @@ void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkex
                             }
                         }
                     } else {
-                        int deadtile = 0;
-                        int deadbit = 0;
+                        bool deadtile = false;
                         if (maze.dead != nullptr) {
-                            deadtile = maze.dead[(realy * maze.width + realx) / 8];
-                            deadbit = (realy * maze.width + realx) % 8;
+                            deadtile = getBit(maze, maze.dead, realx, realy);
                         }
                         
-                        if (deadtile & (1 << deadbit)) {
+                        if (deadtile) {
                             attron(COLOR_PAIR(5));
                             mvaddch(y, x * 2, 'X');
                             mvaddch(y, x * 2 + 1, 'X');
@@ -329,7 +1073,18 @@ void displayMaze(Maze maze, Player player, Camera* cam, Player nav, bool checkex
 
 
 
-void exploreMaze(Maze maze, Player player, int depth = 0) {
+// marks a tile explored. a dead tile that wasn't explored before is added to revealed, if given
+inline void revealTile(const Maze& maze, std::vector<Player>* revealed, int x, int y) {
+    if (getBit(maze, maze.explored, x, y)) {
+        return;
+    }
+    setBit(maze, maze.explored, x, y);
+    if (revealed != nullptr && maze.dead != nullptr && getBit(maze, maze.dead, x, y)) {
+        revealed->push_back({x, y});
+    }
+}
+
+void castRays(const Maze& maze, Player player, std::vector<Player>* revealed) {
     // raycast in all 4 directions from the player, until a wall is hit
     // mark all tiles included as explorered, including the hit wall
     // when we raycast we also want to do the tiles next to the ray. ex: casting right, we also want to mark the tile above and below the ray
@@ -338,25 +1093,25 @@ void exploreMaze(Maze maze, Player player, int depth = 0) {
     // 3x3 around player
     for (int y = player.y - 1; y <= player.y + 1; y++) {
         for (int x = player.x - 1; x <= player.x + 1; x++) {
-            if (x < 0 || x >= maze.width || y < 0 || y >= maze.height) {
+            if (x < 0 || x >= maze.width || y < maze.top || y >= maze.height) {
                 continue;
             }
-            maze.explored[(y * maze.width + x) / 8] |= 1 << ((y * maze.width + x) % 8);
+            revealTile(maze, revealed, x, y);
         }
     }
 
     // right
     for (int x = player.x + 1; x < maze.width; x++) {
         // ray
-        maze.explored[(player.y * maze.width + x) / 8] |= 1 << ((player.y * maze.width + x) % 8);
+        revealTile(maze, revealed, x, player.y);
         // up/down
-        if (player.y > 0) {
-            maze.explored[((player.y - 1) * maze.width + x) / 8] |= 1 << (((player.y - 1) * maze.width + x) % 8);
+        if (player.y > maze.top) {
+            revealTile(maze, revealed, x, player.y - 1);
         }
         if (player.y < maze.height - 1) {
-            maze.explored[((player.y + 1) * maze.width + x) / 8] |= 1 << (((player.y + 1) * maze.width + x) % 8);
+            revealTile(maze, revealed, x, player.y + 1);
         }
-        if (maze.maze[(player.y * maze.width + x) / 8] & (1 << ((player.y * maze.width + x) % 8))) {
+        if (getBit(maze, maze.maze, x, player.y)) {
             break;
         }
     }
@@ -364,15 +1119,15 @@ void exploreMaze(Maze maze, Player player, int depth = 0) {
     // left
     for (int x = player.x - 1; x >= 0; x--) {
         // ray
-        maze.explored[(player.y * maze.width + x) / 8] |= 1 << ((player.y * maze.width + x) % 8);
+        revealTile(maze, revealed, x, player.y);
         // up/down
-        if (player.y > 0) {
-            maze.explored[((player.y - 1) * maze.width + x) / 8] |= 1 << (((player.y - 1) * maze.width + x) % 8);
+        if (player.y > maze.top) {
+            revealTile(maze, revealed, x, player.y - 1);
         }
         if (player.y < maze.height - 1) {
-            maze.explored[((player.y + 1) * maze.width + x) / 8] |= 1 << (((player.y + 1) * maze.width + x) % 8);
+            revealTile(maze, revealed, x, player.y + 1);
         }
-        if (maze.maze[(player.y * maze.width + x) / 8] & (1 << ((player.y * maze.width + x) % 8))) {
+        if (getBit(maze, maze.maze, x, player.y)) {
             break;
         }
     }
@@ -380,43 +1135,58 @@ void exploreMaze(Maze maze, Player player, int depth = 0) {
     // down
     for (int y = player.y + 1; y < maze.height; y++) {
         // ray
-        maze.explored[(y * maze.width + player.x) / 8] |= 1 << ((y * maze.width + player.x) % 8);
+        revealTile(maze, revealed, player.x, y);
         // left/right
         if (player.x > 0) {
-            maze.explored[(y * maze.width + player.x - 1) / 8] |= 1 << ((y * maze.width + player.x - 1) % 8);
+            revealTile(maze, revealed, player.x - 1, y);
         }
         if (player.x < maze.width - 1) {
-            maze.explored[(y * maze.width + player.x + 1) / 8] |= 1 << ((y * maze.width + player.x + 1) % 8);
+            revealTile(maze, revealed, player.x + 1, y);
         }
-        if (maze.maze[(y * maze.width + player.x) / 8] & (1 << ((y * maze.width + player.x) % 8))) {
+        if (getBit(maze, maze.maze, player.x, y)) {
             break;
         }
     }
 
     // up
-    for (int y = player.y - 1; y >= 0; y--) {
+    for (int y = player.y - 1; y >= maze.top; y--) {
         // ray
-        maze.explored[(y * maze.width + player.x) / 8] |= 1 << ((y * maze.width + player.x) % 8);
+        revealTile(maze, revealed, player.x, y);
         // left/right
         if (player.x > 0) {
-            maze.explored[(y * maze.width + player.x - 1) / 8] |= 1 << ((y * maze.width + player.x - 1) % 8);
+            revealTile(maze, revealed, player.x - 1, y);
         }
         if (player.x < maze.width - 1) {
-            maze.explored[(y * maze.width + player.x + 1) / 8] |= 1 << ((y * maze.width + player.x + 1) % 8);
+            revealTile(maze, revealed, player.x + 1, y);
         }
-        if (maze.maze[(y * maze.width + player.x) / 8] & (1 << ((y * maze.width + player.x) % 8))) {
+        if (getBit(maze, maze.maze, player.x, y)) {
             break;
         }
     }
+}
 
-    // if a dead cell is explored, then all connected dead cells should also be explored as well as surrounding cells
-    // we can just call this same function again, but with the dead cell as the player
-    if (depth > 1) return;
-    if (maze.dead != nullptr) {
-        for (int i = 0; i < maze.width * maze.height; i++) {
-            if (maze.dead[i / 8] & (1 << (i % 8)) && maze.explored[i / 8] & (1 << (i % 8))) {
-                Player deadplayer = {i % maze.width, i / maze.width};
-                exploreMaze(maze, deadplayer, depth + 1); // probably should add a depth limit
+// dead tiles are explored whole: once part of a dead end corridor comes into view, every tile of it casts its rays like the player does,
+// and whatever dead tiles those reveal are followed the same way. only tiles that weren't explored before are followed,
+// so each corridor is walked once, when it is first seen, instead of looking over the whole maze for dead tiles on every move
+void exploreMaze(const Maze& maze, Player player, bool followdead = true) {
+    std::vector<Player> revealed;
+    castRays(maze, player, followdead ? &revealed : nullptr);
+    std::unordered_set<size_t> walked;
+    const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    while (!revealed.empty()) {
+        Player tile = revealed.back();
+        revealed.pop_back();
+        if (!walked.insert((size_t)(tile.y - maze.top) * maze.width + tile.x).second) {
+            continue;
+        }
+        castRays(maze, tile, &revealed);
+        // the rest of the corridor is the dead tiles next to this one
+        for (int d = 0; d < 4; d++) {
+            int x = tile.x + dirs[d][0];
+            int y = tile.y + dirs[d][1];
+            if (x >= 0 && x < maze.width && y >= maze.top && y < maze.height && !getBit(maze, maze.maze, x, y) && getBit(maze, maze.dead, x, y) &&
+                walked.count((size_t)(y - maze.top) * maze.width + x) == 0) {
+                revealed.push_back({x, y});
             }
         }
     }
@@ -427,296 +1197,3295 @@ struct TileState {
     bool wall;
 };
 
-TileState getTileState(Maze maze, int x, int y) {
-    int tile = maze.maze[(y * maze.width + x) / 8];
-    int bit = (y * maze.width + x) % 8;
-    return {(maze.explored[(y * maze.width + x) / 8] & (1 << bit)) != 0, (tile & (1 << bit)) != 0};
+TileState getTileState(const Maze& maze, int x, int y) {
+    return {getBit(maze, maze.explored, x, y), getBit(maze, maze.maze, x, y)};
 }
 
-TileState getPlayerTileState(Maze maze, Player player) {
+TileState getPlayerTileState(const Maze& maze, Player player) {
     return getTileState(maze, player.x, player.y);
 }
 
-void navigateMaze(Maze* maze, Player from, Player to) {
-    // we will do all the navigation calculations first, and then we will mark the path with the navmap
-    // we will use a breadth first search to find the shortest path to the destination
-    // we will use a queue to keep track of the tiles we need to explore
-
-    // we will also keep track of the parent of each tile, so we can trace back the path
+// a fixed set of threads that all run the same job, each with its own index, and are waited for together.
+// the calling thread runs index 0, so a pool of one has no threads at all
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::function<void(int)> job;
+    uint64_t round = 0;
+    int running = 0;
+    bool stopping = false;
 
-    if (maze->navmap != nullptr) {
-        delete[] maze->navmap;
-        maze->navmap = nullptr;
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
     }
+};
 
-    if (getTileState(*maze, to.x, to.y).wall) {
-        return;
+int poolSize(const WorkerPool& pool) {
+    return pool.threads.size() + 1;
+}
+
+void startWorkerPool(WorkerPool* pool, int size) {
+    for (int i = 1; i < size; i++) {
+        pool->threads.emplace_back([pool, i]() {
+            uint64_t seen = 0;
+            while (true) {
+                std::function<void(int)> job;
+                {
+                    std::unique_lock<std::mutex> guard(pool->lock);
+                    pool->wake.wait(guard, [&]() { return pool->stopping || pool->round != seen; });
+                    if (pool->stopping) {
+                        return;
+                    }
+                    seen = pool->round;
+                    job = pool->job;
+                }
+                job(i);
+                std::lock_guard<std::mutex> guard(pool->lock);
+                if (--pool->running == 0) {
+                    pool->finished.notify_one();
+                }
+            }
+        });
     }
-    if (to.x == from.x && to.y == from.y) {
+}
+
+void runWorkerPool(WorkerPool* pool, std::function<void(int)> job) {
+    if (pool->threads.empty()) {
+        job(0);
         return;
     }
-    if (!getTileState(*maze, to.x, to.y).explored) {
-        return;
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->job = job;
+        pool->running = pool->threads.size();
+        pool->round++;
     }
+    pool->wake.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> guard(pool->lock);
+    pool->finished.wait(guard, [&]() { return pool->running == 0; });
+}
 
-
-    std::queue<Player> q;
-    q.push(from);
-
-    int* parent = new int[maze->width * maze->height];
-
-    for (int i = 0; i < maze->width * maze->height; i++) {
-        parent[i] = -1;
+// ors mask into a plane word, with an atomic or if other threads may be writing the same plane. returns how many bits were new.
+// a single writer still stores relaxed, like setBit, since an export may be reading
+inline int orWord(uint64_t* word, uint64_t mask, bool shared) {
+    uint64_t old;
+    if (shared) {
+        old = __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+    } else {
+        old = __atomic_load_n(word, __ATOMIC_RELAXED);
+        __atomic_store_n(word, old | mask, __ATOMIC_RELAXED);
     }
+    return __builtin_popcountll(mask & ~old);
+}
 
-    parent[from.y * maze->width + from.x] = -2;
+// reads a plane word that another thread may be writing, like the explored plane while the bots of a batch explore or the game runs next to an export
+inline uint64_t loadWord(const uint64_t* word) {
+    return __atomic_load_n(word, __ATOMIC_RELAXED);
+}
+
+// sets every tile in the rectangle x0..x1, y0..y1 a word at a time, returns how many of them weren't set before
+uint64_t orRect(const Maze& maze, uint64_t* plane, int x0, int x1, int y0, int y1, bool shared) {
+    uint64_t added = 0;
+    switch (maze.layout) {
+        case Layout::Tiled:
+        case Layout::Morton: {
+            size_t tilesx = (maze.width + 7) >> 3;
+            for (int ty = y0 >> 3; ty <= y1 >> 3; ty++) {
+                int top = std::max(y0, ty * 8) - ty * 8;
+                int bottom = std::min(y1, ty * 8 + 7) - ty * 8;
+                uint32_t rows = ((2u << bottom) - 1) & ~((1u << top) - 1);
+                size_t tiley = (ty * 8 & maze.rowmask) >> 3;
+                for (int tx = x0 >> 3; tx <= x1 >> 3; tx++) {
+                    int left = std::max(x0, tx * 8) - tx * 8;
+                    int right = std::min(x1, tx * 8 + 7) - tx * 8;
+                    uint32_t columns = ((2u << right) - 1) & ~((1u << left) - 1);
+                    // the row and column bits of a tile never overlap, so multiplying a column by a row is the rectangle
+                    size_t w;
+                    uint64_t mask;
+                    if (maze.layout == Layout::Tiled) {
+                        w = tiley * tilesx + tx;
+                        mask = TILE_MASKS.tiledcolumn[rows] * columns;
+                    } else {
+                        w = mortonWord(maze.width, tx, tiley);
+                        mask = TILE_MASKS.mortoncolumn[rows] * TILE_MASKS.mortonrow[columns];
+                    }
+                    int n = orWord(&plane[w], mask, shared);
+                    if (n > 0) {
+                        markDirty(maze, plane, w);
+                        added += n;
+                    }
+                }
+            }
+            break;
+        }
+        case Layout::RowMajor:
+        default:
+            for (int y = y0; y <= y1; y++) {
+                size_t start = bitIndex(maze, x0, y);
+                size_t end = start + (x1 - x0);
+                for (size_t w = start / 64; w <= end / 64; w++) {
+                    uint64_t mask = ~(uint64_t)0;
+                    if (w == start / 64) {
+                        mask &= ~(uint64_t)0 << (start % 64);
+                    }
+                    if (w == end / 64) {
+                        mask &= ~(uint64_t)0 >> (63 - end % 64);
+                    }
+                    int n = orWord(&plane[w], mask, shared);
+                    if (n > 0) {
+                        markDirty(maze, plane, w);
+                        added += n;
+                    }
+                }
+            }
+            break;
+    }
+    return added;
+}
+
+// packs the bits of the first row of a morton tile (mortonIndex(0..7, 0)) into 8 consecutive bits, the inverse of TILE_MASKS.mortonrow
+inline uint32_t compactMortonRow(uint64_t v) {
+    v &= 0x330033;
+    v = (v | (v >> 2)) & 0x0f000f;
+    v = (v | (v >> 12)) & 0xff;
+    return v;
+}
+
+// 8 tiles of row y starting at column tx*8, one bit each
+inline uint32_t rowByte(const Maze& maze, const uint64_t* plane, int tx, int y) {
+    switch (maze.layout) {
+        case Layout::Tiled: {
+            size_t tile = (size_t)((y & maze.rowmask) >> 3) * ((maze.width + 7) >> 3) + tx;
+            return (loadWord(&plane[tile]) >> ((y & 7) * 8)) & 0xff;
+        }
+        case Layout::Morton: {
+            // the other rows would shift into the same bits, so they're masked off first
+            int shift = spreadBits(y & 7) << 1;
+            return compactMortonRow((loadWord(&plane[mortonWord(maze.width, tx, (y & maze.rowmask) >> 3)]) & (TILE_MASKS.mortonrow[0xff] << shift)) >> shift);
+        }
+        case Layout::RowMajor:
+        default: {
+            // a row major row can start anywhere in a word
+            size_t i = bitIndex(maze, tx * 8, y);
+            uint64_t bits = loadWord(&plane[i / 64]) >> (i % 64);
+            if (i % 64 > 56 && i / 64 + 1 < maze.words) {
+                bits |= loadWord(&plane[i / 64 + 1]) << (64 - i % 64);
+            }
+            return bits & 0xff;
+        }
+    }
+}
+
+// 8 tiles of column x starting at row ty*8
+inline uint32_t columnByte(const Maze& maze, const uint64_t* plane, int x, int ty) {
+    switch (maze.layout) {
+        case Layout::Tiled: {
+            size_t tile = (size_t)((ty * 8 & maze.rowmask) >> 3) * ((maze.width + 7) >> 3) + (x >> 3);
+            // gathers the lowest bit of every byte into one byte
+            return (((plane[tile] >> (x & 7)) & 0x0101010101010101) * 0x0102040810204080) >> 56;
+        }
+        case Layout::Morton: {
+            // a column is a row with every bit index doubled, so squeeze out the odd bits and it is a row
+            int shift = spreadBits(x & 7);
+            uint64_t v = (plane[mortonWord(maze.width, x >> 3, (ty * 8 & maze.rowmask) >> 3)] & (TILE_MASKS.mortoncolumn[0xff] << shift)) >> shift;
+            v = (v | (v >> 1)) & 0x3333333333333333ull;
+            v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+            v = (v | (v >> 4)) & 0x00FF00FF00FF00FFull;
+            v = (v | (v >> 8)) & 0x0000FFFF0000FFFFull;
+            v = (v | (v >> 16)) & 0xFFFFFFFF;
+            return compactMortonRow(v);
+        }
+        case Layout::RowMajor:
+        default: {
+            uint32_t bits = 0;
+            for (int r = 0; r < 8 && ty * 8 + r < maze.height; r++) {
+                bits |= (uint32_t)getBit(maze, plane, x, ty * 8 + r) << r;
+            }
+            return bits;
+        }
+    }
+}
+
+// how far a raycast from position p goes along a line of length tiles (starting at first) whose walls come 8 at a time from wallbyte:
+// out to the first wall on either side, that wall included
+template <typename WallByte>
+void raycastRun(int p, int first, int length, WallByte wallbyte, int* lo, int* hi) {
+    *hi = length - 1;
+    for (int t = (p + 1) >> 3; t * 8 < length && p < length - 1; t++) {
+        uint32_t walls = wallbyte(t) & (0xffu << std::max(0, p + 1 - t * 8)) & 0xff;
+        if (walls != 0) {
+            *hi = std::min(length - 1, t * 8 + __builtin_ctz(walls));
+            break;
+        }
+    }
+    *lo = first;
+    for (int t = (p - 1) >> 3; t * 8 + 7 >= first && p > first; t--) {
+        uint32_t walls = wallbyte(t) & (0xffu >> std::max(0, t * 8 + 7 - (p - 1)));
+        if (walls != 0) {
+            *lo = std::max(first, t * 8 + 31 - __builtin_clz(walls));
+            break;
+        }
+    }
+}
+
+// what the horizontal raycasts from (x, y) cover
+void rowRun(const Maze& maze, int x, int y, int* x0, int* x1) {
+    raycastRun(x, 0, maze.width, [&](int tx) { return rowByte(maze, maze.maze, tx, y); }, x0, x1);
+}
+
+// and the vertical ones
+void columnRun(const Maze& maze, int x, int y, int* y0, int* y1) {
+    if (maze.layout == Layout::RowMajor) {
+        // every tile of a row major column is in a different word, so reading 8 at a time would only read more of them
+        int up = y;
+        while (up > maze.top) {
+            up--;
+            if (getBit(maze, maze.maze, x, up)) break;
+        }
+        int down = y;
+        while (down < maze.height - 1) {
+            down++;
+            if (getBit(maze, maze.maze, x, down)) break;
+        }
+        *y0 = up;
+        *y1 = down;
+        return;
+    }
+    raycastRun(y, maze.top, maze.height, [&](int ty) { return columnByte(maze, maze.maze, x, ty); }, y0, y1);
+}
+
+// many agents (bots) exploring the same maze as the player. what they see goes into the shared explored plane,
+// so the player and spectators see it too.
+// every tick all of their raycasts are done as one batch: agents in the same run of a row (or column) see exactly the same tiles,
+// so each run is scanned and written once, as word wide ors. the batch is split over a pool of threads by maze band.
+struct Agent {
+    Player pos;
+    int dir;             // direction of the last step, bots don't turn straight back unless they have to
+    uint64_t discovered; // tiles this agent saw before anyone else
+};
+
+// an agent and its position packed so it sorts by row then column (or the other way around)
+struct AgentKey {
+    uint64_t key;
+    uint32_t agent;
+};
+
+struct AgentBatch {
+    std::vector<Agent> agents;
+    std::vector<AgentKey> byrow;
+    std::vector<AgentKey> bycolumn;
+    WorkerPool pool;
+    size_t accounted = 0; // bytes of the agents and their sort keys reported to the memory accounting
+
+    AgentBatch() = default;
+    AgentBatch(const AgentBatch&) = delete;
+    AgentBatch& operator=(const AgentBatch&) = delete;
+    ~AgentBatch() {
+        memFree(MEM_BOTS, accounted);
+    }
+};
+
+const int BOT_TICK_MS = 100;
+
+// bots start on random cells
+void initAgents(AgentBatch* batch, const Maze& maze, int count, int threads) {
+    batch->agents.clear();
+    for (int i = 0; i < count; i++) {
+        Player pos = {1 + 2 * (rand() % (maze.width / 2 - 1)), 1 + 2 * (rand() % (maze.height / 2 - 1))};
+        batch->agents.push_back({pos, rand() % 4, 0});
+    }
+    batch->byrow.resize(count);
+    batch->bycolumn.resize(count);
+    for (int i = 0; i < count; i++) {
+        Player pos = batch->agents[i].pos;
+        batch->byrow[i] = {(uint64_t)pos.y << 32 | pos.x, (uint32_t)i};
+        batch->bycolumn[i] = {(uint64_t)pos.x << 32 | pos.y, (uint32_t)i};
+    }
+    std::sort(batch->byrow.begin(), batch->byrow.end(), [](const AgentKey& a, const AgentKey& b) { return a.key < b.key; });
+    std::sort(batch->bycolumn.begin(), batch->bycolumn.end(), [](const AgentKey& a, const AgentKey& b) { return a.key < b.key; });
+    if (batch->pool.threads.empty()) {
+        startWorkerPool(&batch->pool, std::max(1, threads));
+    }
+    memFree(MEM_BOTS, batch->accounted);
+    batch->accounted = batch->agents.capacity() * sizeof(Agent) + (batch->byrow.capacity() + batch->bycolumn.capacity()) * sizeof(AgentKey);
+    memAlloc(MEM_BOTS, batch->accounted);
+}
+
+// every bot takes one step, at random but never back the way it came unless it is in a dead end
+void moveAgents(AgentBatch* batch, const Maze& maze) {
+    const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}}; // a direction and its opposite only differ in the lowest bit
+    for (Agent& agent : batch->agents) {
+        int options[4];
+        int count = 0;
+        for (int d = 0; d < 4; d++) {
+            int x = agent.pos.x + dirs[d][0];
+            int y = agent.pos.y + dirs[d][1];
+            if (d != (agent.dir ^ 1) && x >= 0 && x < maze.width && y >= maze.top && y < maze.height && !getBit(maze, maze.maze, x, y)) {
+                options[count++] = d;
+            }
+        }
+        int d = count == 0 ? agent.dir ^ 1 : options[rand() % count];
+        agent.pos.x += dirs[d][0];
+        agent.pos.y += dirs[d][1];
+        agent.dir = d;
+    }
+}
+
+// agents only move a step per tick, so last tick's order is nearly sorted already and an insertion sort only has a little to do
+void resortAgents(std::vector<AgentKey>* order, const std::vector<Agent>& agents, bool bycolumn) {
+    std::vector<AgentKey>& keys = *order;
+    for (AgentKey& key : keys) {
+        Player pos = agents[key.agent].pos;
+        key.key = bycolumn ? (uint64_t)pos.x << 32 | pos.y : (uint64_t)pos.y << 32 | pos.x;
+    }
+    for (size_t i = 1; i < keys.size(); i++) {
+        AgentKey key = keys[i];
+        size_t j = i;
+        while (j > 0 && keys[j - 1].key > key.key) {
+            keys[j] = keys[j - 1];
+            j--;
+        }
+        keys[j] = key;
+    }
+}
+
+// the same tiles exploreMaze marks for every agent (without following dead ends), in one batch
+void exploreAgents(AgentBatch* batch, const Maze& maze) {
+    std::vector<Agent>& agents = batch->agents;
+    resortAgents(&batch->byrow, agents, false);
+    resortAgents(&batch->bycolumn, agents, true);
+
+    int threads = poolSize(batch->pool);
+    bool shared = threads > 1;
+    size_t count = agents.size();
+
+    // rows first, each thread takes a band of rows. the first agent in a run gets the credit for what it finds
+    runWorkerPool(&batch->pool, [&](int t) {
+        int runy = -1;
+        int runend = -1;
+        for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) {
+            // the position is in the key, so the agent itself is only touched when it found something
+            int x = (uint32_t)batch->byrow[i].key;
+            int y = batch->byrow[i].key >> 32;
+            if (y == runy && x < runend) {
+                continue;
+            }
+            int x0, x1;
+            rowRun(maze, x, y, &x0, &x1);
+            runy = y;
+            runend = x1;
+            uint64_t added = orRect(maze, maze.explored, x0, x1, std::max(maze.top, y - 1), std::min(maze.height - 1, y + 1), shared);
+            if (added > 0) {
+                agents[batch->byrow[i].agent].discovered += added;
+            }
+        }
+    });
+    // then columns, in bands of columns
+    runWorkerPool(&batch->pool, [&](int t) {
+        int runx = -1;
+        int runend = -1;
+        for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) {
+            int x = batch->bycolumn[i].key >> 32;
+            int y = (uint32_t)batch->bycolumn[i].key;
+            if (x == runx && y < runend) {
+                continue;
+            }
+            int y0, y1;
+            columnRun(maze, x, y, &y0, &y1);
+            runx = x;
+            runend = y1;
+            uint64_t added = orRect(maze, maze.explored, std::max(0, x - 1), std::min(maze.width - 1, x + 1), y0, y1, shared);
+            if (added > 0) {
+                agents[batch->bycolumn[i].agent].discovered += added;
+            }
+        }
+    });
+}
+
+uint64_t agentsDiscovered(const AgentBatch& batch) {
+    uint64_t total = 0;
+    for (const Agent& agent : batch.agents) {
+        total += agent.discovered;
+    }
+    return total;
+}
+
+void displayAgents(const AgentBatch& batch, const Maze& maze, const Camera& cam) {
+    int scrwidth, scrheight;
+    getmaxyx(stdscr, scrheight, scrwidth);
+    attron(COLOR_PAIR(6));
+    for (const Agent& agent : batch.agents) {
+        int x = agent.pos.x - cam.xoffset;
+        int y = agent.pos.y - cam.yoffset;
+        if (x >= 0 && x * 2 + 1 < scrwidth && y >= 0 && y < scrheight && agent.pos.x < maze.width - 1 && agent.pos.y < maze.height - 1) {
+            mvaddch(y, x * 2, '(');
+            mvaddch(y, x * 2 + 1, ')');
+        }
+    }
+    attroff(COLOR_PAIR(6));
+}
+
+// writes the maze as an image: a .pbm gets the walls alone at a bit per pixel, anything else a greyscale .pgm with
+// explored, dead and the navigation path shaded in. every scale x scale block of tiles becomes one pixel (their average).
+// it streams: the planes are read 8 tiles at a time a row at a time and only one row of pixels is ever held,
+// so memory stays at a few words per pixel of width however big the maze is. the planes are read with loadWord and the game
+// only writes them through setBit, clearBit and orWord, which store relaxed, so it can run on another thread while the game keeps
+// exploring. the image is then whatever was explored when each row was read
+const uint8_t EXPORT_SHADES[16] = {
+    // indexed by wall | explored << 1 | dead << 2 | path << 3
+    64, 32, 255, 0, 64, 32, 160, 0,
+    112, 112, 112, 112, 112, 112, 112, 112,
+};
+
+// where the p key saves the maze during a game
+const char* EXPORT_FILE = "maze.pgm";
+
+// explored, dead and route are planes laid out like the maze's, dead and route may be null
+bool exportPlanes(const Maze& maze, const uint64_t* explored, const uint64_t* dead, const uint64_t* route, const char* path, int scale) {
+    size_t length = strlen(path);
+    bool bitmap = length >= 4 && strcmp(path + length - 4, ".pbm") == 0;
+    FILE* f = fopen(path, "wb");
+    if (f == nullptr) {
+        return false;
+    }
+    // the last row and column are past the outer wall, the game doesn't show them either
+    int width = maze.width - 1;
+    int height = maze.height - 1 - maze.top;
+    int pixelswide = (width + scale - 1) / scale;
+    int pixelshigh = (height + scale - 1) / scale;
+    fprintf(f, bitmap ? "P4\n%d %d\n" : "P5\n%d %d\n255\n", pixelswide, pixelshigh);
+
+    std::vector<uint64_t> sums(pixelswide);
+    std::vector<uint8_t> line(bitmap ? (pixelswide + 7) / 8 : pixelswide);
+    size_t accounted = sums.capacity() * sizeof(uint64_t) + line.capacity();
+    memAlloc(MEM_EXPORT, accounted);
+    bool ok = true;
+    for (int py = 0; py < pixelshigh && ok; py++) {
+        std::fill(sums.begin(), sums.end(), 0);
+        int y0 = maze.top + py * scale;
+        int y1 = std::min(maze.top + height, y0 + scale);
+        for (int y = y0; y < y1; y++) {
+            int px = 0;
+            int left = scale; // tiles until the next pixel starts
+            for (int tx = 0; tx * 8 < width; tx++) {
+                uint32_t walls = rowByte(maze, maze.maze, tx, y);
+                uint32_t seen = bitmap ? 0 : rowByte(maze, explored, tx, y);
+                uint32_t deadend = bitmap || dead == nullptr ? 0 : rowByte(maze, dead, tx, y);
+                uint32_t onpath = bitmap || route == nullptr ? 0 : rowByte(maze, route, tx, y);
+                for (int i = 0; i < 8 && tx * 8 + i < width; i++) {
+                    if (bitmap) {
+                        sums[px] += (walls >> i) & 1;
+                    } else {
+                        sums[px] += EXPORT_SHADES[((walls >> i) & 1) | ((seen >> i) & 1) << 1 | ((deadend >> i) & 1) << 2 | ((onpath >> i) & 1) << 3];
+                    }
+                    if (--left == 0) {
+                        px++;
+                        left = scale;
+                    }
+                }
+            }
+        }
+        std::fill(line.begin(), line.end(), 0);
+        for (int px = 0; px < pixelswide; px++) {
+            uint64_t tiles = (uint64_t)(y1 - y0) * (std::min(width, (px + 1) * scale) - px * scale);
+            if (bitmap) {
+                // a pixel is black when at least half its tiles are walls, pbm rows start at the top bit
+                line[px / 8] |= (sums[px] * 2 >= tiles) << (7 - px % 8);
+            } else {
+                line[px] = sums[px] / tiles;
+            }
+        }
+        ok = fwrite(line.data(), 1, line.size(), f) == line.size();
+    }
+    memFree(MEM_EXPORT, accounted);
+    ok = fclose(f) == 0 && ok;
+    return ok;
+}
+
+bool exportMaze(const Maze& maze, const char* path, int scale) {
+    return exportPlanes(maze, maze.explored, maze.dead, maze.navmap, path, scale);
+}
+
+// an export running on its own thread, so a big maze can be saved without stopping the game
+struct ImageExport {
+    std::thread thread;
+    std::atomic<bool> busy{false};
+
+    ~ImageExport() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+// the maze has to outlive the export, finishExport waits for it. the path plane is taken now: the navigator keeps it for the
+// whole game and only changes what is in it, while maze.navmap itself is switched on and off by the game thread
+bool startExport(ImageExport* image, const Maze& maze, const char* path, int scale) {
+    if (image->busy) {
+        return false;
+    }
+    if (image->thread.joinable()) {
+        image->thread.join();
+    }
+    image->busy = true;
+    std::string file = path;
+    const uint64_t* route = maze.navmap;
+    image->thread = std::thread([image, &maze, route, file, scale]() {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        bool ok = exportPlanes(maze, maze.explored, maze.dead, route, file.c_str(), scale);
+        double millis = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1000.0;
+        LOG("%s %s in %lf ms\n", ok ? "Exported" : "Could not export", file.c_str(), millis);
+        image->busy = false;
+    });
+    return true;
+}
+
+void finishExport(ImageExport* image) {
+    if (image->thread.joinable()) {
+        image->thread.join();
+    }
+}
+
+enum class NavMode {
+    AStar,     // a* with a manhattan heuristic, one node per cell
+    JumpPoint, // jump point search, only the cells where the path can turn become nodes
+    Junction,  // a* over the junction graph, corridors are single edges. mazes without a graph use jump points
+};
+
+const char* navModeName(NavMode mode) {
+    switch (mode) {
+        case NavMode::AStar: return "astar";
+        case NavMode::Junction: return "graph";
+        case NavMode::JumpPoint:
+        default: return "jps";
+    }
+}
+
+struct JunctionGraph;
+
+// everything the pathfinder needs is allocated once per maze and reused by every search.
+// instead of clearing g/parent for every cell on each call, a cell is only valid if its stamp matches the current search.
+struct Navigator {
+    struct OpenNode {
+        uint64_t f;
+        uint64_t g;
+        size_t cell;
+    };
+
+    NavMode mode = NavMode::JumpPoint;
+    JunctionGraph* graph = nullptr; // not owned, searched instead of the grid in junction mode
+    // the grid search arrays, one entry per cell. only allocated once the grid is searched
+    std::vector<uint64_t> g;
+    std::vector<size_t> parent;
+    std::vector<uint32_t> stamp;
+    uint32_t search = 0;
+    std::vector<OpenNode> open; // binary heap, smallest f on top
+    std::unique_ptr<uint64_t[]> path; // navmap plane, handed out to the maze
+    std::vector<size_t> pathcells; // cells set in path, so it can be cleared without touching the whole plane
+    int base = 0; // row of cell 0, cells are counted from the top of the maze window
+    size_t expanded = 0; // nodes expanded by the last search
+    uint64_t generation = 0; // bumped by every navigateMaze call whatever it searches, so watchers can tell the path changed
+    size_t arraybytes = 0;
+    size_t pathbytes = 0;
+
+    Navigator() = default;
+    Navigator(const Navigator&) = delete;
+    Navigator& operator=(const Navigator&) = delete;
+    ~Navigator() {
+        memFree(MEM_NAVIGATOR, arraybytes);
+        memFree(MEM_NAVMAP, pathbytes);
+    }
+};
+
+// the search arrays, and the open heap and path cells, which keep whatever size the biggest search so far needed
+void accountNavigator(Navigator* nav) {
+    memFree(MEM_NAVIGATOR, nav->arraybytes);
+    nav->arraybytes = nav->g.capacity() * sizeof(uint64_t) + nav->parent.capacity() * sizeof(size_t) + nav->stamp.capacity() * sizeof(uint32_t) +
+        nav->open.capacity() * sizeof(Navigator::OpenNode) + nav->pathcells.capacity() * sizeof(size_t);
+    memAlloc(MEM_NAVIGATOR, nav->arraybytes);
+}
+
+void initNavigator(Navigator* nav, const Maze& maze, NavMode mode) {
+    nav->mode = mode;
+    nav->g.clear();
+    nav->parent.clear();
+    nav->stamp.clear();
+    nav->search = 0;
+    nav->open.clear();
+    nav->path.reset(new uint64_t[maze.words]());
+    nav->pathcells.clear();
+
+    accountNavigator(nav);
+    memFree(MEM_NAVMAP, nav->pathbytes);
+    nav->pathbytes = maze.words * sizeof(uint64_t);
+    memAlloc(MEM_NAVMAP, nav->pathbytes);
+}
+
+// the grid search arrays are only needed when the grid is searched, a maze navigated through its junction graph never allocates them
+void initGridSearch(Navigator* nav, const Maze& maze) {
+    size_t cells = (size_t)maze.width * maze.rows;
+    if (nav->g.size() == cells) {
+        return;
+    }
+    nav->g.assign(cells, 0);
+    nav->parent.assign(cells, 0);
+    nav->stamp.assign(cells, 0);
+    nav->search = 0;
+    nav->open.reserve(1024);
+    accountNavigator(nav);
+}
+
+// the navigator only walks through cells the player has already seen
+inline size_t navCell(const Maze& maze, int x, int y) {
+    return (size_t)(y - maze.top) * maze.width + x;
+}
+
+inline bool navPassable(const Maze& maze, int x, int y) {
+    if (x < 0 || x >= maze.width || y < maze.top || y >= maze.height) {
+        return false;
+    }
+    return !getBit(maze, maze.maze, x, y) && getBit(maze, maze.explored, x, y);
+}
+
+inline bool openLess(const Navigator::OpenNode& a, const Navigator::OpenNode& b) {
+    // std heap functions build a max heap, so flip the comparison. on equal f prefer the deeper node
+    if (a.f != b.f) return a.f > b.f;
+    return a.g < b.g;
+}
+
+inline void navPush(Navigator* nav, const Maze& maze, size_t cell, size_t from, uint64_t g, Player to) {
+    if (nav->stamp[cell] == nav->search && nav->g[cell] <= g) {
+        return;
+    }
+    nav->stamp[cell] = nav->search;
+    nav->g[cell] = g;
+    nav->parent[cell] = from;
+    int x = cell % maze.width;
+    int y = cell / maze.width + maze.top;
+    uint64_t h = (uint64_t)abs(x - to.x) + abs(y - to.y);
+    nav->open.push_back({g + h, g, cell});
+    std::push_heap(nav->open.begin(), nav->open.end(), openLess);
+}
+
+// jump point search on a 4 connected grid. horizontal jumps only stop where a vertical move is forced,
+// vertical jumps also stop anywhere a horizontal jump from them would find something.
+// returns the cell the jump stopped at, or -1 if it ran into a wall.
+long long jumpHorizontal(const Maze& maze, int x, int y, int dx, Player to) {
+    while (true) {
+        x += dx;
+        if (!navPassable(maze, x, y)) {
+            return -1;
+        }
+        if (x == to.x && y == to.y) {
+            return navCell(maze, x, y);
+        }
+        if ((navPassable(maze, x, y - 1) && !navPassable(maze, x - dx, y - 1)) ||
+            (navPassable(maze, x, y + 1) && !navPassable(maze, x - dx, y + 1))) {
+            return navCell(maze, x, y);
+        }
+    }
+}
+
+long long jumpVertical(const Maze& maze, int x, int y, int dy, Player to) {
+    while (true) {
+        y += dy;
+        if (!navPassable(maze, x, y)) {
+            return -1;
+        }
+        if (x == to.x && y == to.y) {
+            return navCell(maze, x, y);
+        }
+        if ((navPassable(maze, x - 1, y) && !navPassable(maze, x - 1, y - dy)) ||
+            (navPassable(maze, x + 1, y) && !navPassable(maze, x + 1, y - dy))) {
+            return navCell(maze, x, y);
+        }
+        if (jumpHorizontal(maze, x, y, 1, to) != -1 || jumpHorizontal(maze, x, y, -1, to) != -1) {
+            return navCell(maze, x, y);
+        }
+    }
+}
+
+void clearNavPath(Navigator* nav, const Maze& maze) {
+    for (size_t cell : nav->pathcells) {
+        clearBit(maze, nav->path.get(), cell % maze.width, cell / maze.width + nav->base);
+    }
+    nav->pathcells.clear();
+}
+
+// the junction graph is a topology index of the maze, built once from the walls. every open tile that doesn't have exactly
+// two open neighbors (junctions and dead ends) is a node, and the corridors of two neighbor tiles between them are edges.
+// most of a maze is corridor, so searching the graph or marking dead ends on it touches far fewer nodes than the grid has tiles,
+// corridors are only walked tile by tile to check them or to draw a path.
+// endless mazes change underneath a graph, so they don't get one.
+
+const uint32_t NO_NODE = UINT32_MAX;
+const uint32_t NO_EDGE = UINT32_MAX;
+const int GRAPH_DIRS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}}; // a direction and its opposite only differ in the lowest bit
+
+struct JunctionEdge {
+    uint32_t a;
+    uint32_t b;
+    uint8_t dira;    // direction the corridor leaves a in
+    uint8_t dirb;    // direction the corridor leaves b in
+    uint8_t checkdir;
+    uint64_t length; // steps from a to b, the corridor has length - 1 tiles
+    // how far from a the corridor is known to be explored, the tile that far along and the direction of the next step.
+    // explored only grows, so checking carries on from here instead of walking the whole corridor again
+    uint64_t checked;
+    int32_t checkx;
+    int32_t checky;
+};
+
+struct JunctionGraph {
+    std::vector<size_t> nodecell;   // navCell of every node, ascending
+    std::vector<uint32_t> adjstart; // the edges of node n are adj[adjstart[n]] up to adj[adjstart[n + 1]]
+    std::vector<uint32_t> adj;
+    std::vector<JunctionEdge> edges;
+    uint64_t tiles = 0; // open tiles in the maze
+
+    // a spanning tree, for the branch sizes. in a perfect maze it is the maze. only built by buildGraphTree, the game doesn't need it
+    std::vector<uint32_t> treeedge; // edge to the parent, NO_EDGE for a root
+    std::vector<uint64_t> subtree;  // tiles below a node, its own tile and the corridors to its children included
+
+    // search state, stamped like the navigator's
+    std::vector<uint64_t> g;
+    std::vector<uint32_t> via;   // edge a node was reached through, NO_EDGE for the nodes next to the start
+    std::vector<uint32_t> stamp;
+    uint32_t search = 0;
+    std::vector<Navigator::OpenNode> open; // cell holds the node
+    size_t accounted = 0;
+
+    JunctionGraph() = default;
+    JunctionGraph(const JunctionGraph&) = delete;
+    JunctionGraph& operator=(const JunctionGraph&) = delete;
+    ~JunctionGraph() {
+        memFree(MEM_GRAPH, accounted);
+    }
+};
+
+inline bool tileOpen(const Maze& maze, int x, int y) {
+    return x >= 0 && x < maze.width && y >= maze.top && y < maze.height && !getBit(maze, maze.maze, x, y);
+}
+
+inline int openNeighbors(const Maze& maze, int x, int y) {
+    int count = 0;
+    for (int d = 0; d < 4; d++) {
+        count += tileOpen(maze, x + GRAPH_DIRS[d][0], y + GRAPH_DIRS[d][1]);
+    }
+    return count;
+}
+
+// a corridor tile has exactly one way on that isn't the way back (dir is the step that got here).
+// returns false if (x, y) is a node
+inline bool corridorNext(const Maze& maze, int x, int y, int* dir) {
+    int open = 0;
+    int next = -1;
+    for (int d = 0; d < 4; d++) {
+        if (tileOpen(maze, x + GRAPH_DIRS[d][0], y + GRAPH_DIRS[d][1])) {
+            open++;
+            if (d != (*dir ^ 1)) {
+                next = d;
+            }
+        }
+    }
+    if (open != 2) {
+        return false;
+    }
+    *dir = next;
+    return true;
+}
+
+struct CorridorWalk {
+    int x;         // where the walk ended
+    int y;
+    int dir;       // direction of the last step
+    uint64_t length;
+    bool explored; // every tile stepped on was explored
+    bool stopped;  // it ended on the stop tile, not on a node
+};
+
+// follows the corridor leaving (x, y) in direction dir until it reaches a node or the stop tile.
+// every tile stepped on is set in mark, and added to cells if given
+CorridorWalk walkCorridor(const Maze& maze, int x, int y, int dir, Player stop = {-1, -1}, uint64_t* mark = nullptr, std::vector<size_t>* cells = nullptr) {
+    CorridorWalk walk = {x, y, dir, 0, true, false};
+    while (true) {
+        walk.x += GRAPH_DIRS[walk.dir][0];
+        walk.y += GRAPH_DIRS[walk.dir][1];
+        walk.length++;
+        walk.explored = walk.explored && getBit(maze, maze.explored, walk.x, walk.y);
+        if (mark != nullptr) {
+            setBit(maze, mark, walk.x, walk.y);
+            if (cells != nullptr) {
+                cells->push_back(navCell(maze, walk.x, walk.y));
+            }
+        }
+        if (walk.x == stop.x && walk.y == stop.y) {
+            walk.stopped = true;
+            return walk;
+        }
+
+        if (!corridorNext(maze, walk.x, walk.y, &walk.dir)) {
+            return walk;
+        }
+    }
+}
+
+// the node on a tile, or NO_NODE if the tile isn't one
+uint32_t graphNode(const JunctionGraph& graph, size_t cell) {
+    std::vector<size_t>::const_iterator it = std::lower_bound(graph.nodecell.begin(), graph.nodecell.end(), cell);
+    if (it == graph.nodecell.end() || *it != cell) {
+        return NO_NODE;
+    }
+    return it - graph.nodecell.begin();
+}
+
+inline Player graphNodeTile(const JunctionGraph& graph, const Maze& maze, uint32_t node) {
+    return {(int)(graph.nodecell[node] % maze.width), (int)(graph.nodecell[node] / maze.width) + maze.top};
+}
+
+inline uint32_t graphOther(const JunctionEdge& edge, uint32_t node) {
+    return edge.a == node ? edge.b : edge.a;
+}
+
+// the direction edge leaves node in
+inline int graphLeave(const JunctionEdge& edge, uint32_t node) {
+    return edge.a == node ? edge.dira : edge.dirb;
+}
+
+void accountGraph(JunctionGraph* graph) {
+    memFree(MEM_GRAPH, graph->accounted);
+    graph->accounted = graph->nodecell.capacity() * sizeof(size_t) + (graph->adjstart.capacity() + graph->adj.capacity()) * sizeof(uint32_t) +
+        graph->edges.capacity() * sizeof(JunctionEdge) + graph->treeedge.capacity() * sizeof(uint32_t) + graph->subtree.capacity() * sizeof(uint64_t) +
+        graph->g.capacity() * sizeof(uint64_t) + (graph->via.capacity() + graph->stamp.capacity()) * sizeof(uint32_t) +
+        graph->open.capacity() * sizeof(Navigator::OpenNode);
+    memAlloc(MEM_GRAPH, graph->accounted);
+}
+
+void freeJunctionGraph(JunctionGraph* graph) {
+    std::vector<size_t>().swap(graph->nodecell);
+    std::vector<uint32_t>().swap(graph->adjstart);
+    std::vector<uint32_t>().swap(graph->adj);
+    std::vector<JunctionEdge>().swap(graph->edges);
+    std::vector<uint32_t>().swap(graph->treeedge);
+    std::vector<uint64_t>().swap(graph->subtree);
+    std::vector<uint64_t>().swap(graph->g);
+    std::vector<uint32_t>().swap(graph->via);
+    std::vector<uint32_t>().swap(graph->stamp);
+    std::vector<Navigator::OpenNode>().swap(graph->open);
+    accountGraph(graph);
+}
+
+// returns false, leaving the graph empty, if the maze has more nodes or corridor ends than the 32 bit ids can number.
+// the caller falls back to the grid then, like it does for a maze without any nodes
+bool buildJunctionGraph(JunctionGraph* graph, const Maze& maze) {
+    graph->nodecell.clear();
+    graph->edges.clear();
+    graph->tiles = 0;
+    size_t ends = 0; // every corridor has two, one in the adjacency of each node it joins
+    for (int y = maze.top; y < maze.height; y++) {
+        for (int x = 0; x < maze.width; x++) {
+            if (!tileOpen(maze, x, y)) {
+                continue;
+            }
+            graph->tiles++;
+            int open = openNeighbors(maze, x, y);
+            if (open != 2) {
+                graph->nodecell.push_back(navCell(maze, x, y));
+                ends += open;
+            }
+        }
+    }
+    if (graph->nodecell.size() >= NO_NODE || ends >= NO_EDGE) {
+        LOG("Junction graph: %zu nodes and %zu corridor ends are too many for 32 bit ids, using the grid\n", graph->nodecell.size(), ends);
+        freeJunctionGraph(graph);
+        return false;
+    }
+    // a maze that is one big loop has no junctions or dead ends, and is left without a graph
+    uint32_t nodes = graph->nodecell.size();
+
+    // every corridor is walked from both ends, the walk from the lower node (or direction, for a loop back to the same node) keeps it
+    std::vector<uint32_t> degree(nodes + 1, 0);
+    for (uint32_t a = 0; a < nodes; a++) {
+        Player tile = graphNodeTile(*graph, maze, a);
+        for (int d = 0; d < 4; d++) {
+            if (!tileOpen(maze, tile.x + GRAPH_DIRS[d][0], tile.y + GRAPH_DIRS[d][1])) {
+                continue;
+            }
+            degree[a]++;
+            CorridorWalk walk = walkCorridor(maze, tile.x, tile.y, d);
+            uint32_t b = graphNode(*graph, navCell(maze, walk.x, walk.y));
+            int dirb = walk.dir ^ 1;
+            if (a < b || (a == b && d < dirb)) {
+                graph->edges.push_back({a, b, (uint8_t)d, (uint8_t)dirb, (uint8_t)d, walk.length, 0, tile.x, tile.y});
+            }
+        }
+    }
+
+    graph->adjstart.assign(nodes + 1, 0);
+    for (uint32_t n = 0; n < nodes; n++) {
+        graph->adjstart[n + 1] = graph->adjstart[n] + degree[n];
+    }
+    graph->adj.assign(graph->adjstart[nodes], 0);
+    std::fill(degree.begin(), degree.end(), 0);
+    for (uint32_t e = 0; e < graph->edges.size(); e++) {
+        const JunctionEdge& edge = graph->edges[e];
+        graph->adj[graph->adjstart[edge.a] + degree[edge.a]++] = e;
+        graph->adj[graph->adjstart[edge.b] + degree[edge.b]++] = e;
+    }
+
+    // both grew by pushing, drop the slack
+    graph->nodecell.shrink_to_fit();
+    graph->edges.shrink_to_fit();
+    graph->g.assign(nodes, 0);
+    graph->via.assign(nodes, NO_EDGE);
+    graph->stamp.assign(nodes, 0);
+    graph->search = 0;
+    graph->open.clear();
+    graph->open.reserve(1024);
+    accountGraph(graph);
+
+    LOG("Junction graph: %zu tiles, %u nodes, %zu edges\n", (size_t)graph->tiles, nodes, graph->edges.size());
+    return true;
+}
+
+// breadth first spanning tree, then add up the branch sizes from the leaves in
+void buildGraphTree(JunctionGraph* graph) {
+    uint32_t nodes = graph->nodecell.size();
+    graph->treeedge.assign(nodes, NO_EDGE);
+    graph->subtree.assign(nodes, 1);
+    std::vector<uint8_t> seen(nodes, 0);
+    std::vector<uint32_t> order;
+    order.reserve(nodes);
+    for (uint32_t root = 0; root < nodes; root++) {
+        if (seen[root]) {
+            continue;
+        }
+        seen[root] = 1;
+        order.push_back(root);
+        for (size_t i = order.size() - 1; i < order.size(); i++) {
+            uint32_t n = order[i];
+            for (uint32_t k = graph->adjstart[n]; k < graph->adjstart[n + 1]; k++) {
+                uint32_t other = graphOther(graph->edges[graph->adj[k]], n);
+                if (!seen[other]) {
+                    seen[other] = 1;
+                    graph->treeedge[other] = graph->adj[k];
+                    order.push_back(other);
+                }
+            }
+        }
+    }
+    for (size_t i = order.size(); i-- > 0;) {
+        uint32_t n = order[i];
+        if (graph->treeedge[n] != NO_EDGE) {
+            const JunctionEdge& edge = graph->edges[graph->treeedge[n]];
+            graph->subtree[graphOther(edge, n)] += graph->subtree[n] + edge.length - 1;
+        }
+    }
+    accountGraph(graph);
+}
+
+// the corridor a tile is on, or NO_EDGE for walls and nodes. walks to one end of the corridor to find out
+uint32_t graphCorridor(const JunctionGraph& graph, const Maze& maze, int x, int y) {
+    if (graph.nodecell.empty() || !tileOpen(maze, x, y) || openNeighbors(maze, x, y) != 2) {
+        return NO_EDGE;
+    }
+    int d = 0;
+    while (!tileOpen(maze, x + GRAPH_DIRS[d][0], y + GRAPH_DIRS[d][1])) d++;
+    CorridorWalk walk = walkCorridor(maze, x, y, d);
+    uint32_t node = graphNode(graph, navCell(maze, walk.x, walk.y));
+    if (node == NO_NODE) {
+        return NO_EDGE;
+    }
+    int leave = walk.dir ^ 1;
+    for (uint32_t k = graph.adjstart[node]; k < graph.adjstart[node + 1]; k++) {
+        const JunctionEdge& edge = graph.edges[graph.adj[k]];
+        if ((edge.a == node && edge.dira == leave) || (edge.b == node && edge.dirb == leave)) {
+            return graph.adj[k];
+        }
+    }
+    return NO_EDGE;
+}
+
+// how many tiles are behind edge seen from node, its own corridor included. needs buildGraphTree.
+// in a braided maze this is measured on the spanning tree, a corridor that closes a loop only counts itself
+uint64_t graphBranchTiles(const JunctionGraph& graph, uint32_t node, uint32_t e) {
+    const JunctionEdge& edge = graph.edges[e];
+    uint32_t other = graphOther(edge, node);
+    if (graph.treeedge[other] == e && other != node) {
+        return edge.length - 1 + graph.subtree[other];
+    }
+    if (graph.treeedge[node] == e) {
+        // the edge goes up the tree, so it's everything in the tree except this node's branch
+        uint32_t root = node;
+        while (graph.treeedge[root] != NO_EDGE) {
+            root = graphOther(graph.edges[graph.treeedge[root]], root);
+        }
+        return graph.subtree[root] - graph.subtree[node];
+    }
+    return edge.length - 1;
+}
+
+// a corridor ending in a dead end is dead all the way back to the junction it comes off.
+// this is what the sweeps of deadAnalysis converge to, found in one pass over the dead ends
+void markGraphDead(const JunctionGraph& graph, Maze* maze) {
+    for (uint32_t n = 0; n < graph.nodecell.size(); n++) {
+        if (graph.adjstart[n + 1] - graph.adjstart[n] != 1) {
+            continue;
+        }
+        const JunctionEdge& edge = graph.edges[graph.adj[graph.adjstart[n]]];
+        Player tile = graphNodeTile(graph, *maze, n);
+        setBit(*maze, maze->dead, tile.x, tile.y);
+        CorridorWalk walk = walkCorridor(*maze, tile.x, tile.y, graphLeave(edge, n), {-1, -1}, maze->dead);
+        if (openNeighbors(*maze, walk.x, walk.y) != 1) {
+            // the junction at the other end isn't dead, only the corridor
+            clearBit(*maze, maze->dead, walk.x, walk.y);
+        }
+    }
+}
+
+// every tile past a is explored (b included)
+inline bool graphEdgeExplored(JunctionGraph* graph, const Maze& maze, uint32_t e) {
+    JunctionEdge& edge = graph->edges[e];
+    while (edge.checked < edge.length) {
+        int x = edge.checkx + GRAPH_DIRS[edge.checkdir][0];
+        int y = edge.checky + GRAPH_DIRS[edge.checkdir][1];
+        if (!getBit(maze, maze.explored, x, y)) {
+            return false;
+        }
+        edge.checked++;
+        edge.checkx = x;
+        edge.checky = y;
+        int dir = edge.checkdir;
+        if (edge.checked < edge.length && corridorNext(maze, x, y, &dir)) {
+            edge.checkdir = dir;
+        }
+    }
+    return true;
+}
+
+// how a tile joins the graph. a node is its own end, a corridor tile has the nodes at both ends of its corridor
+struct GraphAttach {
+    int count;
+    uint32_t node[2];
+    uint64_t dist[2];
+    int dir[2];        // direction from the tile towards the node
+    int back[2];       // direction from the node back towards the tile
+    bool usable[2];    // the way to the node is explored and doesn't run into the other end of the search
+};
+
+// attaches (x, y) to the graph. if the walk along its corridor reaches other first, that is a direct path, its length is kept in direct
+// along with the direction it leaves (x, y) in and the direction it leaves other in
+GraphAttach graphAttach(const JunctionGraph& graph, const Maze& maze, int x, int y, Player other, uint64_t* direct, int* directdir, int* directback) {
+    GraphAttach attach = {};
+    uint32_t node = graphNode(graph, navCell(maze, x, y));
+    if (node != NO_NODE) {
+        attach.count = 1;
+        attach.node[0] = node;
+        attach.dir[0] = attach.back[0] = -1;
+        attach.usable[0] = true;
+        return attach;
+    }
+    for (int d = 0; d < 4; d++) {
+        if (!tileOpen(maze, x + GRAPH_DIRS[d][0], y + GRAPH_DIRS[d][1])) {
+            continue;
+        }
+        CorridorWalk walk = walkCorridor(maze, x, y, d, other);
+        int i = attach.count++;
+        attach.node[i] = graphNode(graph, navCell(maze, walk.x, walk.y));
+        attach.dist[i] = walk.length;
+        attach.dir[i] = d;
+        attach.back[i] = walk.dir ^ 1;
+        attach.usable[i] = walk.explored && !walk.stopped;
+        if (walk.stopped && walk.explored && walk.length < *direct) {
+            *direct = walk.length;
+            *directdir = d;
+            *directback = walk.dir ^ 1;
+        }
+    }
+    return attach;
+}
+
+inline void graphPush(JunctionGraph* graph, const Maze& maze, uint32_t node, uint32_t via, uint64_t g, Player to) {
+    if (graph->stamp[node] == graph->search && graph->g[node] <= g) {
+        return;
+    }
+    graph->stamp[node] = graph->search;
+    graph->g[node] = g;
+    graph->via[node] = via;
+    Player tile = graphNodeTile(*graph, maze, node);
+    uint64_t h = (uint64_t)abs(tile.x - to.x) + abs(tile.y - to.y);
+    graph->open.push_back({g + h, g, node});
+    std::push_heap(graph->open.begin(), graph->open.end(), openLess);
+}
+
+// shortest path from one explored tile to another through explored tiles, found on the graph and then walked out into the navigator's path.
+// returns the length, or UINT64_MAX if there is no path
+uint64_t navigateGraph(JunctionGraph* graph, const Maze& maze, Navigator* nav, Player from, Player to) {
+    // a start on the goal's corridor (or the other way around) may be reached directly along it
+    uint64_t best = UINT64_MAX;
+    int directdir = -1;
+    int unused;
+    GraphAttach start = graphAttach(*graph, maze, from.x, from.y, to, &best, &directdir, &unused);
+    uint64_t goaldirect = UINT64_MAX;
+    int goalback = -1;
+    GraphAttach goal = graphAttach(*graph, maze, to.x, to.y, from, &goaldirect, &unused, &goalback);
+    if (goaldirect < best) {
+        best = goaldirect;
+        directdir = goalback;
+    }
+
+    graph->search++;
+    if (graph->search == 0) {
+        std::fill(graph->stamp.begin(), graph->stamp.end(), 0);
+        graph->search = 1;
+    }
+    graph->open.clear();
+    for (int i = 0; i < start.count; i++) {
+        if (start.usable[i]) {
+            graphPush(graph, maze, start.node[i], NO_EDGE, start.dist[i], to);
+        }
+    }
+
+    uint32_t bestnode = NO_NODE;
+    int bestside = -1;
+    while (!graph->open.empty()) {
+        std::pop_heap(graph->open.begin(), graph->open.end(), openLess);
+        Navigator::OpenNode current = graph->open.back();
+        graph->open.pop_back();
+        uint32_t node = current.cell;
+
+        if (current.g != graph->g[node]) {
+            continue;
+        }
+        // the heuristic never overestimates, so nothing left can beat the best found
+        if (current.f >= best) {
+            break;
+        }
+        nav->expanded++;
+
+        for (int i = 0; i < goal.count; i++) {
+            if (goal.usable[i] && goal.node[i] == node && current.g + goal.dist[i] < best) {
+                best = current.g + goal.dist[i];
+                bestnode = node;
+                bestside = i;
+            }
+        }
+
+        for (uint32_t k = graph->adjstart[node]; k < graph->adjstart[node + 1]; k++) {
+            uint32_t e = graph->adj[k];
+            uint32_t other = graphOther(graph->edges[e], node);
+            Player tile = graphNodeTile(*graph, maze, other);
+            if (!getBit(maze, maze.explored, tile.x, tile.y) || !graphEdgeExplored(graph, maze, e)) {
+                continue;
+            }
+            graphPush(graph, maze, other, e, current.g + graph->edges[e].length, to);
+        }
+    }
+
+    if (best == UINT64_MAX) {
+        return best;
+    }
+
+    // walk the path out, every tile from just past the start to the goal is marked once
+    uint64_t* path = nav->path.get();
+    if (bestnode == NO_NODE) {
+        walkCorridor(maze, from.x, from.y, directdir, to, path, &nav->pathcells);
+        return best;
+    }
+    uint32_t node = bestnode;
+    Player tile = graphNodeTile(*graph, maze, node);
+    if (goal.dir[bestside] != -1) {
+        walkCorridor(maze, tile.x, tile.y, goal.back[bestside], to, path, &nav->pathcells);
+    }
+    while (graph->via[node] != NO_EDGE) {
+        const JunctionEdge& edge = graph->edges[graph->via[node]];
+        uint32_t parent = graphOther(edge, node);
+        Player ptile = graphNodeTile(*graph, maze, parent);
+        walkCorridor(maze, ptile.x, ptile.y, graphLeave(edge, parent), {-1, -1}, path, &nav->pathcells);
+        node = parent;
+    }
+    for (int i = 0; i < start.count; i++) {
+        if (start.dir[i] != -1 && start.node[i] == node && start.usable[i] && start.dist[i] == graph->g[node]) {
+            walkCorridor(maze, from.x, from.y, start.dir[i], {-1, -1}, path, &nav->pathcells);
+            break;
+        }
+    }
+    return best;
+}
+
+void navigateMaze(Maze* maze, Navigator* nav, Player from, Player to) {
+    // we will do all the navigation calculations first, and then we will mark the path with the navmap
+    // the search only expands nodes towards the destination (a*), and with jump points whole corridors are skipped at once
+
+    maze->navmap = nullptr;
+    clearNavPath(nav, *maze);
+    nav->expanded = 0;
+    nav->generation++;
+
+    if (getTileState(*maze, to.x, to.y).wall) {
+        return;
+    }
+    if (to.x == from.x && to.y == from.y) {
+        return;
+    }
+    if (!getTileState(*maze, to.x, to.y).explored) {
+        return;
+    }
+
+    nav->base = maze->top;
+    if (nav->mode == NavMode::Junction && nav->graph != nullptr && !nav->graph->nodecell.empty()) {
+        bool found = navigateGraph(nav->graph, *maze, nav, from, to) != UINT64_MAX;
+        LOG("%s expanded %zu nodes\n", navModeName(nav->mode), nav->expanded);
+        accountGraph(nav->graph);
+        accountNavigator(nav);
+        if (found) {
+            maze->navmap = nav->path.get();
+        }
+        return;
+    }
+
+    initGridSearch(nav, *maze);
+    nav->search++;
+    if (nav->search == 0) {
+        // the stamps wrapped around, so old stamps could look current
+        std::fill(nav->stamp.begin(), nav->stamp.end(), 0);
+        nav->search = 1;
+    }
+    nav->open.clear();
+
+    size_t start = navCell(*maze, from.x, from.y);
+    size_t goal = navCell(*maze, to.x, to.y);
+    navPush(nav, *maze, start, start, 0, to);
+
+    bool found = false;
+    const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+    while (!nav->open.empty()) {
+        std::pop_heap(nav->open.begin(), nav->open.end(), openLess);
+        Navigator::OpenNode current = nav->open.back();
+        nav->open.pop_back();
+
+        if (current.g != nav->g[current.cell]) {
+            // a shorter way to this cell was found after it was pushed
+            continue;
+        }
+        if (current.cell == goal) {
+            found = true;
+            break;
+        }
+        nav->expanded++;
+
+        int cx = current.cell % maze->width;
+        int cy = current.cell / maze->width + nav->base;
+        int px = nav->parent[current.cell] % maze->width;
+        int py = nav->parent[current.cell] / maze->width + nav->base;
+
+        for (int d = 0; d < 4; d++) {
+            int dx = dirs[d][0];
+            int dy = dirs[d][1];
+
+            if (nav->mode == NavMode::AStar) {
+                if (navPassable(*maze, cx + dx, cy + dy)) {
+                    navPush(nav, *maze, current.cell + (long long)dy * maze->width + dx, current.cell, current.g + 1, to);
+                }
+                continue;
+            }
+
+            // never jump straight back the way we came
+            if (current.cell != start && ((dx != 0 && (px - cx) * dx > 0 && py == cy) || (dy != 0 && (py - cy) * dy > 0 && px == cx))) {
+                continue;
+            }
+            long long jump = dx != 0 ? jumpHorizontal(*maze, cx, cy, dx, to) : jumpVertical(*maze, cx, cy, dy, to);
+            if (jump != -1) {
+                int jx = jump % maze->width;
+                int jy = jump / maze->width + nav->base;
+                navPush(nav, *maze, jump, current.cell, current.g + abs(jx - cx) + abs(jy - cy), to);
+            }
+        }
+    }
+
+    LOG("%s expanded %zu nodes\n", navModeName(nav->mode), nav->expanded);
+
+    if (!found) {
+        accountNavigator(nav);
+        return;
+    }
+
+    // now that we have the parent of each node, we can trace back the path
+    // jump point parents can be a whole corridor away, so fill in the straight line between them
+
+    size_t current = goal;
+    while (current != start) {
+        size_t next = nav->parent[current];
+        int x = current % maze->width;
+        int y = current / maze->width + nav->base;
+        int nx = next % maze->width;
+        int ny = next / maze->width + nav->base;
+        while (x != nx || y != ny) {
+            setBit(*maze, nav->path.get(), x, y);
+            nav->pathcells.push_back(navCell(*maze, x, y));
+            x += (nx > x) - (nx < x);
+            y += (ny > y) - (ny < y);
+        }
+        current = next;
+    }
+
+    maze->navmap = nav->path.get();
+    accountNavigator(nav);
+}
+
+
+
+void deadAnalysis(Maze* maze, Player player) {
+    // if a cell only has 2 directions, and one leads to an empty hallway (or other dead cells), then it is a dead cell
+
+    // in an endless maze the rows past either end of the window are unknown, so cells on the edge rows can't be called dead
+    bool ring = maze->rowmask != -1;
+
+    // for each cell, check if it is a dead cell
+    for (int x = 0; x < maze->width; x++) {
+        for (int y = maze->top; y < maze->height; y++) {
+            if (getTileState(*maze, x, y).wall || (ring && (y == maze->top || y == maze->height - 1))) {
+                continue;
+            }
+
+            int numempty = 0;
+
+            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
+            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
+            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
+            if (y > maze->top && !getTileState(*maze, x, y - 1).wall) numempty++;
+
+            if (numempty == 1) {
+                // this is a dead end
+                setBit(*maze, maze->dead, x, y);
+            }
+            if (numempty == 2) {
+                // if one direction leads to a dead end, then this is also a dead end
+                if (x < maze->width - 1) {
+                    if (!getTileState(*maze, x + 1, y).wall && getBit(*maze, maze->dead, x + 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (x > 0) {
+                    if (!getTileState(*maze, x - 1, y).wall && getBit(*maze, maze->dead, x - 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y < maze->height - 1) {
+                    if (!getTileState(*maze, x, y + 1).wall && getBit(*maze, maze->dead, x, y + 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y > maze->top) {
+                    if (!getTileState(*maze, x, y - 1).wall && getBit(*maze, maze->dead, x, y - 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+            }
+        }
+    }
+    for (int x = maze->width - 1; x > 0; x--) {
+        for (int y = maze->top; y < maze->height; y++) {
+            if (getTileState(*maze, x, y).wall || (ring && (y == maze->top || y == maze->height - 1))) {
+                continue;
+            }
+
+            int numempty = 0;
+
+            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
+            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
+            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
+            if (y > maze->top && !getTileState(*maze, x, y - 1).wall) numempty++;
+
+            if (numempty == 1) {
+                // this is a dead end
+                setBit(*maze, maze->dead, x, y);
+            }
+            if (numempty == 2) {
+                // if one direction leads to a dead end, then this is also a dead end
+                if (x < maze->width - 1) {
+                    if (!getTileState(*maze, x + 1, y).wall && getBit(*maze, maze->dead, x + 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (x > 0) {
+                    if (!getTileState(*maze, x - 1, y).wall && getBit(*maze, maze->dead, x - 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y < maze->height - 1) {
+                    if (!getTileState(*maze, x, y + 1).wall && getBit(*maze, maze->dead, x, y + 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y > maze->top) {
+                    if (!getTileState(*maze, x, y - 1).wall && getBit(*maze, maze->dead, x, y - 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+            }
+        }
+    }
+    for (int x = 0; x < maze->width; x++) {
+        for (int y = maze->height - 1; y > maze->top; y--) {
+            if (getTileState(*maze, x, y).wall || (ring && (y == maze->top || y == maze->height - 1))) {
+                continue;
+            }
+
+            int numempty = 0;
+
+            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
+            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
+            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
+            if (y > maze->top && !getTileState(*maze, x, y - 1).wall) numempty++;
+
+            if (numempty == 1) {
+                // this is a dead end
+                setBit(*maze, maze->dead, x, y);
+            }
+            if (numempty == 2) {
+                // if one direction leads to a dead end, then this is also a dead end
+                if (x < maze->width - 1) {
+                    if (!getTileState(*maze, x + 1, y).wall && getBit(*maze, maze->dead, x + 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (x > 0) {
+                    if (!getTileState(*maze, x - 1, y).wall && getBit(*maze, maze->dead, x - 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y < maze->height - 1) {
+                    if (!getTileState(*maze, x, y + 1).wall && getBit(*maze, maze->dead, x, y + 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y > maze->top) {
+                    if (!getTileState(*maze, x, y - 1).wall && getBit(*maze, maze->dead, x, y - 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+            }
+        }
+    }
+    for (int x = maze->width-1; x > 0; x--) {
+        for (int y = maze->height-1; y > maze->top; y--) {
+            if (getTileState(*maze, x, y).wall || (ring && (y == maze->top || y == maze->height - 1))) {
+                continue;
+            }
+
+            int numempty = 0;
+
+            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
+            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
+            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
+            if (y > maze->top && !getTileState(*maze, x, y - 1).wall) numempty++;
+
+            if (numempty == 1) {
+                // this is a dead end
+                setBit(*maze, maze->dead, x, y);
+            }
+            if (numempty == 2) {
+                // if one direction leads to a dead end, then this is also a dead end
+                if (x < maze->width - 1) {
+                    if (!getTileState(*maze, x + 1, y).wall && getBit(*maze, maze->dead, x + 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (x > 0) {
+                    if (!getTileState(*maze, x - 1, y).wall && getBit(*maze, maze->dead, x - 1, y)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y < maze->height - 1) {
+                    if (!getTileState(*maze, x, y + 1).wall && getBit(*maze, maze->dead, x, y + 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+                if (y > maze->top) {
+                    if (!getTileState(*maze, x, y - 1).wall && getBit(*maze, maze->dead, x, y - 1)) {
+                        setBit(*maze, maze->dead, x, y);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// a session is the maze, what has been explored/found dead, where the player is and how long they have been playing.
+// session.snap holds a full copy of it, session.log is an append only list of checkpoints since then,
+// each holding only the words of explored and dead that changed. replaying the log on top of the snapshot gives the latest state.
+// when the log gets long it is compacted into a new snapshot on a background thread.
+
+const char* SESSION_SNAP = "session.snap";
+const char* SESSION_LOG = "session.log";
+const char* SESSION_OLD_LOG = "session.log.1"; // the log that is being compacted
+
+const uint32_t SNAP_MAGIC = 0x32504E53;       // "SNP2"
+const uint32_t CHECKPOINT_MAGIC = 0x54504B43; // "CKPT"
+const uint32_t CHECKPOINT_END = 0x45444E45;   // "ENDE"
+const uint64_t DEAD_PLANE_BIT = (uint64_t)1 << 63;
+
+struct SnapHeader {
+    uint32_t magic;
+    uint32_t layout;
+    int32_t width;
+    int32_t height;
+    uint64_t words;
+    uint64_t seq; // last checkpoint included in the snapshot
+    int32_t playerx;
+    int32_t playery;
+    double elapsed;
+    uint32_t seed; // what the maze was generated with, so a resumed run records the right maze
+    uint32_t pad;
+    double braid;
+};
+
+struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t seq;
+    int32_t playerx;
+    int32_t playery;
+    double elapsed;
+};
+
+struct CheckpointEntry {
+    uint64_t index; // word index, DEAD_PLANE_BIT set for the dead plane
+    uint64_t value; // the whole word, so replaying a checkpoint twice is harmless
+};
+
+struct CheckpointFooter {
+    uint32_t magic;
+    uint32_t checksum; // a checkpoint cut off by a crash won't match and is ignored
+};
+
+struct Journal {
+    FILE* log = nullptr;
+    std::vector<uint64_t> explored; // what replaying the files currently gives
+    std::vector<uint64_t> dead;
+    std::vector<CheckpointEntry> entries;
+    DirtyWords dirty; // the blocks of explored and dead that may differ from the ones above
+    uint64_t seq = 0;
+    size_t logentries = 0;
+    uint32_t seed = 0; // of the maze, written into every snapshot
+    double braid = 0;
+    std::thread compactor;
+    std::atomic<bool> compacting{false};
+    size_t accounted = 0; // bytes of explored and dead reported to the memory accounting
+};
+
+void accountJournal(Journal* journal) {
+    memFree(MEM_JOURNAL, journal->accounted);
+    journal->accounted = (journal->explored.capacity() + journal->dead.capacity()) * sizeof(uint64_t);
+    memAlloc(MEM_JOURNAL, journal->accounted);
+}
+
+uint32_t checkpointChecksum(const CheckpointHeader& header, const CheckpointEntry* entries, size_t count) {
+    // fnv-1a
+    uint32_t hash = 2166136261u;
+    const uint8_t* bytes = (const uint8_t*)&header;
+    for (size_t i = 0; i < sizeof(header); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = (const uint8_t*)entries;
+    for (size_t i = 0; i < count * sizeof(CheckpointEntry); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// write to a temp file and rename it over the old snapshot, so a crash never leaves a half written one
+bool writeSnapshot(const Maze& maze, const uint64_t* explored, const uint64_t* dead, uint64_t seq, Player player, double elapsed, uint32_t seed,
+    double braid) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", SESSION_SNAP);
+    FILE* f = fopen(tmp, "wb");
+    if (f == nullptr) {
+        LOG("Could not write %s\n", tmp);
+        return false;
+    }
+    SnapHeader header = {SNAP_MAGIC, (uint32_t)maze.layout, maze.width, maze.height, maze.words, seq, player.x, player.y, elapsed, seed, 0, braid};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(maze.maze, sizeof(uint64_t), maze.words, f) == maze.words;
+    ok = ok && fwrite(explored, sizeof(uint64_t), maze.words, f) == maze.words;
+    ok = ok && fwrite(dead, sizeof(uint64_t), maze.words, f) == maze.words;
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    fclose(f);
+    if (!ok || rename(tmp, SESSION_SNAP) != 0) {
+        LOG("Could not write %s\n", SESSION_SNAP);
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+void applyEntries(const CheckpointEntry* entries, size_t count, std::vector<uint64_t>& explored, std::vector<uint64_t>& dead) {
+    for (size_t i = 0; i < count; i++) {
+        std::vector<uint64_t>& plane = (entries[i].index & DEAD_PLANE_BIT) ? dead : explored;
+        uint64_t index = entries[i].index & ~DEAD_PLANE_BIT;
+        if (index < plane.size()) {
+            plane[index] = entries[i].value;
+        }
+    }
+}
+
+// replays the complete checkpoints in a log newer than the snapshot, returns the byte length of the valid part
+long replayLog(const char* path, Journal* journal, Player* player, double* elapsed) {
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        return 0;
+    }
+    long valid = 0;
+    CheckpointHeader header;
+    while (fread(&header, sizeof(header), 1, f) == 1 && header.magic == CHECKPOINT_MAGIC) {
+        journal->entries.resize(header.count);
+        CheckpointFooter footer;
+        if (fread(journal->entries.data(), sizeof(CheckpointEntry), header.count, f) != header.count ||
+            fread(&footer, sizeof(footer), 1, f) != 1 || footer.magic != CHECKPOINT_END ||
+            footer.checksum != checkpointChecksum(header, journal->entries.data(), header.count)) {
+            break;
+        }
+        valid = ftell(f);
+        if (header.seq <= journal->seq) {
+            // already part of the snapshot
+            continue;
+        }
+        applyEntries(journal->entries.data(), journal->entries.size(), journal->explored, journal->dead);
+        journal->seq = header.seq;
+        *player = {header.playerx, header.playery};
+        *elapsed = header.elapsed;
+    }
+    fclose(f);
+    return valid;
+}
+
+// start journaling a new session, throwing away whatever session was there before
+void startJournal(Journal* journal, const Maze& maze, Player player, uint32_t seed, double braid) {
+    journal->explored.assign(maze.explored, maze.explored + maze.words);
+    journal->dead.assign(maze.words, 0);
+    if (maze.dead != nullptr) {
+        journal->dead.assign(maze.dead, maze.dead + maze.words);
+    }
+    accountJournal(journal);
+    initDirty(&journal->dirty, maze.words, MEM_JOURNAL);
+    journal->seq = 0;
+    journal->logentries = 0;
+    journal->seed = seed;
+    journal->braid = braid;
+    writeSnapshot(maze, journal->explored.data(), journal->dead.data(), 0, player, 0, seed, braid);
+    remove(SESSION_OLD_LOG);
+    journal->log = fopen(SESSION_LOG, "wb");
+}
+
+// reads the header of the last session's snapshot, returns false if there is none
+bool readSnapHeader(FILE* f, SnapHeader* header) {
+    return fread(header, sizeof(*header), 1, f) == 1 && header->magic == SNAP_MAGIC && header->layout <= (uint32_t)Layout::Morton &&
+           header->width > 0 && header->height > 0 && header->words == planeWords((Layout)header->layout, header->width, header->height);
+}
+
+bool peekSession(SnapHeader* header) {
+    FILE* f = fopen(SESSION_SNAP, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    bool ok = readSnapHeader(f, header);
+    fclose(f);
+    return ok;
+}
+
+// load the last session, returns false if there is none
+bool resumeJournal(Journal* journal, Maze* maze, Player* player, double* elapsed) {
+    FILE* f = fopen(SESSION_SNAP, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    SnapHeader header;
+    if (!readSnapHeader(f, &header)) {
+        fclose(f);
+        return false;
+    }
+    Maze loaded(header.width, header.height, (Layout)header.layout);
+    if (loaded.storage == nullptr) {
+        LOG("Not enough memory to resume a %dx%d session\n", header.width, header.height);
+        fclose(f);
+        return false;
+    }
+    journal->explored.assign(loaded.words, 0);
+    journal->dead.assign(loaded.words, 0);
+    accountJournal(journal);
+    bool ok = fread(loaded.maze, sizeof(uint64_t), loaded.words, f) == loaded.words;
+    ok = ok && fread(journal->explored.data(), sizeof(uint64_t), loaded.words, f) == loaded.words;
+    ok = ok && fread(journal->dead.data(), sizeof(uint64_t), loaded.words, f) == loaded.words;
+    fclose(f);
+    if (!ok) {
+        return false;
+    }
+    journal->seq = header.seq;
+    journal->seed = header.seed;
+    journal->braid = header.braid;
+    *player = {header.playerx, header.playery};
+    *elapsed = header.elapsed;
+
+    // the old log is only there if a compaction didn't finish, the checkpoints in it are older than the ones in the current log
+    bool oldlog = access(SESSION_OLD_LOG, F_OK) == 0;
+    replayLog(SESSION_OLD_LOG, journal, player, elapsed);
+    long valid = replayLog(SESSION_LOG, journal, player, elapsed);
+    if (oldlog && writeSnapshot(loaded, journal->explored.data(), journal->dead.data(), journal->seq, *player, *elapsed, journal->seed, journal->braid)) {
+        // finish that compaction now, the new snapshot has everything in both logs
+        remove(SESSION_OLD_LOG);
+        valid = 0;
+    }
+    // drop a checkpoint that was cut off, so new ones are appended right after the last good one
+    if (access(SESSION_LOG, F_OK) == 0 && truncate(SESSION_LOG, valid) != 0) {
+        LOG("Could not truncate %s\n", SESSION_LOG);
+    }
+    journal->log = fopen(SESSION_LOG, "ab");
+    journal->logentries = 0;
+    initDirty(&journal->dirty, loaded.words, MEM_JOURNAL);
+
+    std::copy(journal->explored.begin(), journal->explored.end(), loaded.explored);
+    std::copy(journal->dead.begin(), journal->dead.end(), loaded.dead);
+    *maze = std::move(loaded);
+    return true;
+}
+
+// adds the checkpoints of one log to the end of another. if that fails the other log is cut back to how it was,
+// so it never ends in half a checkpoint that would hide everything after it
+bool appendLog(const char* from, const char* to) {
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "ab");
+    bool ok = in != nullptr && out != nullptr;
+    long size = ok && fseek(out, 0, SEEK_END) == 0 ? ftell(out) : -1;
+    ok = ok && size >= 0;
+    char buffer[65536];
+    size_t n;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, n, out) == n;
+    }
+    ok = ok && !ferror(in) && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if (!ok && size >= 0 && ftruncate(fileno(out), size) != 0) {
+        LOG("Could not truncate %s\n", to);
+    }
+    if (in != nullptr) {
+        fclose(in);
+    }
+    if (out != nullptr) {
+        ok = fclose(out) == 0 && ok;
+    }
+    return ok;
+}
+
+void compactJournal(Journal* journal, const Maze& maze, Player player, double elapsed) {
+    if (journal->compactor.joinable()) {
+        journal->compactor.join();
+    }
+    // seal the current log, new checkpoints go into a fresh one while the snapshot is written
+    fclose(journal->log);
+    bool sealed = access(SESSION_OLD_LOG, F_OK) != 0 ? rename(SESSION_LOG, SESSION_OLD_LOG) == 0 : appendLog(SESSION_LOG, SESSION_OLD_LOG);
+    if (!sealed) {
+        // the current log couldn't be set aside (or added to the one a failed compaction left), and it holds checkpoints
+        // the snapshot doesn't have, so keep writing to it and try again next time
+        LOG("Could not move %s to %s, compacting later\n", SESSION_LOG, SESSION_OLD_LOG);
+        journal->log = fopen(SESSION_LOG, "ab");
+        return;
+    }
+    journal->log = fopen(SESSION_LOG, "wb");
+    journal->logentries = 0;
+
+    journal->compacting = true;
+    std::vector<uint64_t> explored = journal->explored;
+    std::vector<uint64_t> dead = journal->dead;
+    uint64_t seq = journal->seq;
+    uint32_t seed = journal->seed;
+    double braid = journal->braid;
+    // the walls never change, so the thread can read them straight from the maze
+    const Maze* walls = &maze;
+    journal->compactor = std::thread([journal, walls, explored = std::move(explored), dead = std::move(dead), seq, player, elapsed, seed, braid]() {
+        if (writeSnapshot(*walls, explored.data(), dead.data(), seq, player, elapsed, seed, braid)) {
+            remove(SESSION_OLD_LOG);
+        }
+        journal->compacting = false;
+    });
+}
+
+// appends the words of explored and dead in a block that differ from the copies of them in last, leaving last as it was
+void diffBlock(std::vector<CheckpointEntry>& entries, const Maze& maze, size_t block, const std::vector<uint64_t>& lastexplored, const std::vector<uint64_t>& lastdead) {
+    size_t start = block << DIRTY_BLOCK_SHIFT;
+    size_t end = std::min(start + DIRTY_BLOCK, maze.words);
+    for (size_t i = start; i < end; i++) {
+        uint64_t word = __atomic_load_n(&maze.explored[i], __ATOMIC_RELAXED);
+        if (word != lastexplored[i]) {
+            entries.push_back({i, word});
+        }
+    }
+    if (maze.dead != nullptr) {
+        for (size_t i = start; i < end; i++) {
+            uint64_t word = __atomic_load_n(&maze.dead[i], __ATOMIC_RELAXED);
+            if (word != lastdead[i]) {
+                entries.push_back({i | DEAD_PLANE_BIT, word});
+            }
+        }
+    }
+}
+
+// append the words that changed since the last checkpoint to the log. if the log can't be written journaling stops,
+// the session can still be resumed from the checkpoints before, and false is returned
+bool checkpointJournal(Journal* journal, const Maze& maze, Player player, double elapsed) {
+    if (journal->log == nullptr) {
+        return true;
+    }
+    journal->entries.clear();
+    takeDirty(&journal->dirty, [&](size_t block) { diffBlock(journal->entries, maze, block, journal->explored, journal->dead); });
+    applyEntries(journal->entries.data(), journal->entries.size(), journal->explored, journal->dead);
+
+    journal->seq++;
+    CheckpointHeader header = {CHECKPOINT_MAGIC, (uint32_t)journal->entries.size(), journal->seq, player.x, player.y, elapsed};
+    CheckpointFooter footer = {CHECKPOINT_END, checkpointChecksum(header, journal->entries.data(), journal->entries.size())};
+    bool ok = fwrite(&header, sizeof(header), 1, journal->log) == 1;
+    ok = ok && fwrite(journal->entries.data(), sizeof(CheckpointEntry), journal->entries.size(), journal->log) == journal->entries.size();
+    ok = ok && fwrite(&footer, sizeof(footer), 1, journal->log) == 1;
+    ok = ok && fflush(journal->log) == 0;
+    if (!ok) {
+        // a checkpoint cut off here is dropped when the session is resumed
+        LOG("Could not write %s, no longer journaling\n", SESSION_LOG);
+        fclose(journal->log);
+        journal->log = nullptr;
+        return false;
+    }
+    journal->logentries += journal->entries.size() + 1;
+
+    // once the log holds about as much as a snapshot, replaying it costs more than rewriting the snapshot
+    if (journal->logentries > maze.words / 2 + 1024 && !journal->compacting) {
+        compactJournal(journal, maze, player, elapsed);
+    }
+    return true;
+}
+
+// finished sessions have nothing to resume, so their files are removed
+void endJournal(Journal* journal, bool finished) {
+    if (journal->compactor.joinable()) {
+        journal->compactor.join();
+    }
+    if (journal->log != nullptr) {
+        fclose(journal->log);
+        journal->log = nullptr;
+    }
+    std::vector<uint64_t>().swap(journal->explored);
+    std::vector<uint64_t>().swap(journal->dead);
+    accountJournal(journal);
+    freeDirty(&journal->dirty);
+    if (finished) {
+        remove(SESSION_SNAP);
+        remove(SESSION_LOG);
+        remove(SESSION_OLD_LOG);
+    }
+}
+
+// finished runs go into results.log, an append only list of fixed size records, so every run ever played is kept.
+// results.idx is a sorted copy of the (width, height, braid, time) of every record up to some point in the log.
+// it is mmapped and binary searched, so the best time and a run's rank for a maze are found in O(log n) however long the log gets.
+// the records appended after the index was written (the tail) are scanned, and once there are RESULT_INDEX_TAIL of them
+// they are merged into a new index, which replaces the old one with a rename so readers always see a whole index
+
+struct ResultFiles {
+    const char* log;
+    const char* index;
+};
+
+const ResultFiles RESULT_FILES = {"results.log", "results.idx"};
+
+const uint32_t RESULT_MAGIC = 0x324C5352;       // "RSL2"
+const uint32_t RESULT_INDEX_MAGIC = 0x58444952; // "RIDX"
+const uint64_t RESULT_INDEX_TAIL = 4096;
+
+const uint32_t RESULT_RESUMED = 1; // moves, teleports and the curve only cover the part played after resuming
+
+struct ResultRecord {
+    uint32_t magic;
+    uint32_t checksum; // of everything after it, so a record cut off by a crash is ignored
+    int64_t timestamp;
+    uint32_t seed;
+    uint32_t flags;
+    int32_t width;
+    int32_t height;
+    double braid;
+    double time;
+    uint64_t moves;
+    uint64_t teleports;
+    uint64_t curve; // hash of the explored count every time it went up and the move it went up on
+};
+
+struct ResultIndexHeader {
+    uint32_t magic;
+    uint32_t entrysize;
+    uint64_t records; // how much of the log the index covers
+    uint64_t entries; // records that were valid, the ones cut off aren't indexed
+};
+
+struct ResultIndexEntry {
+    int32_t width;
+    int32_t height;
+    double braid;
+    double time;
+    uint64_t record; // position in the log
+};
+
+inline bool operator<(const ResultIndexEntry& a, const ResultIndexEntry& b) {
+    if (a.width != b.width) return a.width < b.width;
+    if (a.height != b.height) return a.height < b.height;
+    if (a.braid != b.braid) return a.braid < b.braid;
+    return a.time < b.time;
+}
+
+// how a time compares to the runs of the same size and braid in the log
+struct ResultStats {
+    uint64_t runs;
+    uint64_t faster; // runs that took less time
+    double best;
+};
+
+uint32_t resultChecksum(const ResultRecord& record) {
+    // fnv-1a a word at a time, lookups check every record of the tail so this has to be quick
+    uint64_t hash = 14695981039346656037ull;
+    const uint64_t* words = (const uint64_t*)((const uint8_t*)&record + offsetof(ResultRecord, timestamp));
+    for (size_t i = 0; i < (sizeof(record) - offsetof(ResultRecord, timestamp)) / 8; i++) {
+        hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    return hash ^ (hash >> 32);
+}
+
+bool validResult(const ResultRecord& record) {
+    return record.magic == RESULT_MAGIC && record.checksum == resultChecksum(record);
+}
+
+// folds one more value into the explored curve hash, fnv-1a over its bytes
+uint64_t hashCurve(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+const uint64_t CURVE_SEED = 14695981039346656037ull;
+
+// each record is one write to a file opened for appending, so runs finishing at the same time on a shared machine don't interleave.
+// the log is locked while it is checked for a cut off record and appended to, otherwise one writer could truncate away
+// a record another writer appended between its fstat and its ftruncate
+bool appendResult(const ResultFiles& files, ResultRecord record) {
+    record.magic = RESULT_MAGIC;
+    record.checksum = resultChecksum(record);
+    int fd = open(files.log, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size % sizeof(ResultRecord) != 0) {
+        // a record was cut off, drop it so this one lands on a record boundary
+        LOG("Dropping %ld bytes of a cut off result\n", (long)(st.st_size % sizeof(ResultRecord)));
+        if (ftruncate(fd, st.st_size - st.st_size % sizeof(ResultRecord)) != 0) {
+            close(fd);
+            return false;
+        }
+    }
+    bool ok = write(fd, &record, sizeof(record)) == sizeof(record);
+    // closing drops the lock
+    ok = close(fd) == 0 && ok;
+    return ok;
+}
+
+// the index mapped read only. a missing or broken index maps as empty, then everything in the log is tail
+struct MappedResultIndex {
+    void* map = nullptr;
+    size_t bytes = 0;
+    uint64_t records = 0;
+    const ResultIndexEntry* entries = nullptr;
+    uint64_t count = 0;
+
+    MappedResultIndex() = default;
+    MappedResultIndex(const MappedResultIndex&) = delete;
+    MappedResultIndex& operator=(const MappedResultIndex&) = delete;
+    ~MappedResultIndex() {
+        if (map != nullptr) {
+            munmap(map, bytes);
+        }
+    }
+};
+
+void mapResultIndex(const ResultFiles& files, MappedResultIndex* index) {
+    int fd = open(files.index, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ResultIndexHeader)) {
+        close(fd);
+        return;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    const ResultIndexHeader* header = (const ResultIndexHeader*)map;
+    if (header->magic != RESULT_INDEX_MAGIC || header->entrysize != sizeof(ResultIndexEntry) ||
+        (uint64_t)st.st_size != sizeof(ResultIndexHeader) + header->entries * sizeof(ResultIndexEntry)) {
+        LOG("Ignoring broken result index %s\n", files.index);
+        munmap(map, st.st_size);
+        return;
+    }
+    index->map = map;
+    index->bytes = st.st_size;
+    index->records = header->records;
+    index->entries = (const ResultIndexEntry*)(header + 1);
+    index->count = header->entries;
+}
+
+// the records of the log past the index
+std::vector<ResultIndexEntry> readResultTail(const ResultFiles& files, uint64_t from, uint64_t* total) {
+    std::vector<ResultIndexEntry> tail;
+    *total = from;
+    int fd = open(files.log, O_RDONLY);
+    if (fd < 0) {
+        return tail;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        *total = st.st_size / sizeof(ResultRecord);
+        std::vector<ResultRecord> records(std::min<uint64_t>(*total - std::min(from, *total), 1024));
+        uint64_t at = from;
+        while (at < *total) {
+            size_t count = std::min<uint64_t>(records.size(), *total - at);
+            ssize_t got = pread(fd, records.data(), count * sizeof(ResultRecord), at * sizeof(ResultRecord));
+            if (got <= 0) {
+                break;
+            }
+            count = got / sizeof(ResultRecord);
+            for (size_t i = 0; i < count; i++) {
+                if (validResult(records[i])) {
+                    tail.push_back({records[i].width, records[i].height, records[i].braid, records[i].time, at + i});
+                }
+            }
+            at += count;
+        }
+    }
+    close(fd);
+    return tail;
+}
+
+// where a time lands among all runs of a maze: the index is binary searched, the tail is short enough to just scan
+ResultStats lookupResults(const ResultFiles& files, int width, int height, double braid, double time) {
+    MappedResultIndex index;
+    mapResultIndex(files, &index);
+    uint64_t total;
+    std::vector<ResultIndexEntry> tail = readResultTail(files, index.records, &total);
+    if (total < index.records) {
+        // the log is shorter than what the index covers, so the index belongs to some other log
+        tail = readResultTail(files, 0, &total);
+        index.count = 0;
+    }
+
+    const ResultIndexEntry* end = index.entries + index.count;
+    const ResultIndexEntry* first = std::lower_bound(index.entries, end, ResultIndexEntry{width, height, braid, -HUGE_VAL, 0});
+    const ResultIndexEntry* last = std::lower_bound(first, end, ResultIndexEntry{width, height, braid, HUGE_VAL, 0});
+    const ResultIndexEntry* slower = std::lower_bound(first, last, ResultIndexEntry{width, height, braid, time, 0});
+    ResultStats stats = {(uint64_t)(last - first), (uint64_t)(slower - first), first < last ? first->time : HUGE_VAL};
+    for (const ResultIndexEntry& entry : tail) {
+        if (entry.width == width && entry.height == height && entry.braid == braid) {
+            stats.runs++;
+            stats.faster += entry.time < time;
+            stats.best = std::min(stats.best, entry.time);
+        }
+    }
+    return stats;
+}
+
+// once the tail has grown to RESULT_INDEX_TAIL records (or always, if forced) a new index is written with the tail merged in.
+// that streams through the old index once, so it never holds more than the tail in memory
+bool mergeResultIndex(const ResultFiles& files, bool force) {
+    MappedResultIndex index;
+    mapResultIndex(files, &index);
+    struct stat st;
+    uint64_t total = stat(files.log, &st) == 0 ? st.st_size / sizeof(ResultRecord) : 0;
+    if (total < index.records) {
+        index.records = index.count = 0;
+    }
+    if (total - index.records < RESULT_INDEX_TAIL && !force) {
+        return true;
+    }
+    std::vector<ResultIndexEntry> tail = readResultTail(files, index.records, &total);
+    std::sort(tail.begin(), tail.end());
+
+    // every process writes its own temporary file, whichever rename comes last wins and both are whole indexes
+    std::string temp = std::string(files.index) + "." + std::to_string(getpid());
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (f == nullptr) {
+        return false;
+    }
+    ResultIndexHeader header = {RESULT_INDEX_MAGIC, sizeof(ResultIndexEntry), total, index.count + tail.size()};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    const ResultIndexEntry* old = index.entries;
+    const ResultIndexEntry* oldend = index.entries + index.count;
+    size_t t = 0;
+    while (ok && (old < oldend || t < tail.size())) {
+        const ResultIndexEntry* next = t == tail.size() || (old < oldend && !(tail[t] < *old)) ? old++ : &tail[t++];
+        ok = fwrite(next, sizeof(*next), 1, f) == 1;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(temp.c_str(), files.index) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    LOG("Merged %zu results into %s, it now covers %lu\n", tail.size(), files.index, (unsigned long)total);
+    return true;
+}
+
+// the fastest runs of a maze, best first
+void printLeaderboard(const ResultFiles& files, int width, int height, double braid, int count) {
+    MappedResultIndex index;
+    mapResultIndex(files, &index);
+    uint64_t total;
+    std::vector<ResultIndexEntry> tail = readResultTail(files, index.records, &total);
+    if (total < index.records) {
+        tail = readResultTail(files, 0, &total);
+        index.count = 0;
+    }
+    const ResultIndexEntry* end = index.entries + index.count;
+    const ResultIndexEntry* first = std::lower_bound(index.entries, end, ResultIndexEntry{width, height, braid, -HUGE_VAL, 0});
+    const ResultIndexEntry* last = std::lower_bound(first, end, ResultIndexEntry{width, height, braid, HUGE_VAL, 0});
+    std::vector<ResultIndexEntry> best(first, first + std::min<size_t>(count, last - first));
+    for (const ResultIndexEntry& entry : tail) {
+        if (entry.width == width && entry.height == height && entry.braid == braid) {
+            best.push_back(entry);
+        }
+    }
+    std::sort(best.begin(), best.end());
+    best.resize(std::min<size_t>(best.size(), count));
+
+    ResultStats stats = lookupResults(files, width, height, braid, HUGE_VAL);
+    printf("%lu runs of a %dx%d maze, braid %g\n", (unsigned long)stats.runs, width, height, braid);
+    int fd = open(files.log, O_RDONLY);
+    for (size_t i = 0; i < best.size(); i++) {
+        ResultRecord record;
+        if (fd < 0 || pread(fd, &record, sizeof(record), best[i].record * sizeof(record)) != sizeof(record) || !validResult(record)) {
+            continue;
+        }
+        char date[32];
+        time_t when = record.timestamp;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&when));
+        printf("%3zu. %10.3lf  seed %10u  %6lu moves  %4lu teleports  %s%s\n", i + 1, record.time, record.seed, (unsigned long)record.moves,
+            (unsigned long)record.teleports, date, record.flags & RESULT_RESUMED ? "  (resumed)" : "");
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// spectators connect to a unix socket and watch the game live.
+// a new spectator gets one keyframe (the walls, explored and dead planes), after that only deltas:
+// the words that changed, where the player is and the current navigation path.
+// the server runs its own epoll loop, the game thread only diffs the planes and hands the message over.
+// a spectator that can't keep up gets its backlog thrown away and a fresh keyframe, and is dropped if that keeps happening.
+
+enum SpectateType : uint32_t {
+    SPECTATE_KEYFRAME = 1,
+    SPECTATE_DELTA = 2,
+};
+
+struct SpectateFrame {
+    uint32_t type;
+    uint32_t pad;
+    uint64_t length; // bytes after this frame header
+};
+
+struct KeyframeHeader {
+    uint32_t layout;
+    int32_t width;
+    int32_t height;
+    int32_t playerx;
+    int32_t playery;
+    uint32_t pad;
+    uint64_t words; // followed by the walls, explored and dead planes
+};
+
+struct DeltaHeader {
+    int32_t playerx;
+    int32_t playery;
+    uint32_t count;    // CheckpointEntry words that changed
+    int32_t pathcount; // path cells (y * width + x) that follow the entries, 0 clears the path, -1 keeps it
+};
+
+typedef std::shared_ptr<std::vector<uint8_t>> SpectateBuffer;
+
+struct SpectatorClient {
+    int fd;
+    std::deque<SpectateBuffer> out;
+    size_t offset = 0; // bytes of out.front() already sent
+    size_t queued = 0;
+    bool keyframe = true;
+    bool writing = false; // registered for EPOLLOUT
+    int resyncs = 0;
+};
+
+struct SpectatorServer {
+    int listenfd = -1;
+    int epollfd = -1;
+    int wakefd = -1;
+    std::string path;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // shared with the game thread, guarded by lock
+    std::mutex lock;
+    Layout layout = Layout::RowMajor;
+    int width = 0;
+    int height = 0;
+    size_t words = 0;
+    std::vector<uint64_t> walls;
+    std::vector<uint64_t> explored;
+    std::vector<uint64_t> dead;
+    Player player = {-1, -1};
+    std::vector<uint64_t> pathcells;
+    bool pathshown = false;
+    std::vector<SpectateBuffer> pending;
+
+    // game thread only, the shadow planes above are only written by it so it can compare them without the lock
+    std::vector<CheckpointEntry> entries;
+    DirtyWords dirty; // the blocks of explored and dead that may differ from the shadow planes
+    uint64_t lastgeneration = 0;
+
+    // server thread only
+    std::unordered_map<int, SpectatorClient> clients;
+    size_t maxqueue = 0;
+
+    // stats
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> fanoutnanos{0};
+    std::atomic<uint64_t> resynced{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+// a message is shared by every client it is queued for, so it is accounted once, from when it is made until the last client has sent it
+SpectateBuffer spectateMessage(SpectateType type, size_t length) {
+    size_t bytes = sizeof(SpectateFrame) + length;
+    memAlloc(MEM_SPECTATORS, bytes);
+    SpectateBuffer buffer(new std::vector<uint8_t>(bytes), [bytes](std::vector<uint8_t>* message) {
+        memFree(MEM_SPECTATORS, bytes);
+        delete message;
+    });
+    SpectateFrame frame = {type, 0, length};
+    memcpy(buffer->data(), &frame, sizeof(frame));
+    return buffer;
+}
+
+// must be called with the lock held
+SpectateBuffer spectateKeyframe(SpectatorServer* server) {
+    size_t words = server->words;
+    SpectateBuffer buffer = spectateMessage(SPECTATE_KEYFRAME, sizeof(KeyframeHeader) + words * 3 * sizeof(uint64_t));
+    KeyframeHeader header = {(uint32_t)server->layout, server->width, server->height, server->player.x, server->player.y, 0, words};
+    uint8_t* out = buffer->data() + sizeof(SpectateFrame);
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, server->walls.data(), words * sizeof(uint64_t));
+    memcpy(out + words * sizeof(uint64_t), server->explored.data(), words * sizeof(uint64_t));
+    memcpy(out + words * 2 * sizeof(uint64_t), server->dead.data(), words * sizeof(uint64_t));
+    return buffer;
+}
+
+void dropSpectator(SpectatorServer* server, int fd) {
+    epoll_ctl(server->epollfd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    server->clients.erase(fd);
+}
+
+// returns false if the spectator hung up
+bool flushSpectator(SpectatorServer* server, SpectatorClient& client) {
+    while (!client.out.empty()) {
+        // send as much of the backlog as possible in one call
+        iovec iov[16];
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        for (size_t i = 0; i < client.out.size() && msg.msg_iovlen < 16; i++) {
+            size_t skip = i == 0 ? client.offset : 0;
+            iov[msg.msg_iovlen].iov_base = client.out[i]->data() + skip;
+            iov[msg.msg_iovlen].iov_len = client.out[i]->size() - skip;
+            msg.msg_iovlen++;
+        }
+        ssize_t sent = sendmsg(client.fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+        client.queued -= sent;
+        while (sent > 0) {
+            size_t left = client.out.front()->size() - client.offset;
+            if ((size_t)sent < left) {
+                client.offset += sent;
+                break;
+            }
+            sent -= left;
+            client.out.pop_front();
+            client.offset = 0;
+        }
+        if (client.offset > 0) {
+            // the socket buffer is full
+            break;
+        }
+    }
+    if (client.out.empty()) {
+        client.resyncs = 0;
+    }
+    // only wait for the socket to be writable while there is something to send
+    bool writing = !client.out.empty();
+    if (writing != client.writing) {
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP | (writing ? EPOLLOUT : 0);
+        event.data.fd = client.fd;
+        epoll_ctl(server->epollfd, EPOLL_CTL_MOD, client.fd, &event);
+        client.writing = writing;
+    }
+    return true;
+}
+
+void queueSpectator(SpectatorServer* server, SpectatorClient& client, const SpectateBuffer& buffer) {
+    if (client.queued > server->maxqueue) {
+        // too far behind, throw the backlog away and start over from a keyframe.
+        // a message that is half sent has to finish, or the stream would be out of sync
+        while (client.out.size() > (client.offset > 0 ? 1 : 0)) {
+            client.queued -= client.out.back()->size();
+            client.out.pop_back();
+        }
+        client.keyframe = true;
+        client.resyncs++;
+        server->resynced++;
+        return;
+    }
+    client.out.push_back(buffer);
+    client.queued += buffer->size();
+}
+
+// hand the messages the game thread published to every spectator
+void distributeSpectators(SpectatorServer* server) {
+    std::vector<SpectateBuffer> pending;
+    SpectateBuffer keyframe;
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        pending.swap(server->pending);
+        // the keyframe already includes everything pending, so spectators that get it skip the deltas
+        for (auto& it : server->clients) {
+            if (it.second.keyframe) {
+                keyframe = spectateKeyframe(server);
+                break;
+            }
+        }
+    }
+    if (pending.empty() && keyframe == nullptr) {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<int> hungup;
+    for (auto& it : server->clients) {
+        SpectatorClient& client = it.second;
+        if (client.keyframe) {
+            if (client.resyncs > 3) {
+                hungup.push_back(client.fd);
+                server->dropped++;
+                continue;
+            }
+            if (keyframe != nullptr) {
+                client.keyframe = false;
+                queueSpectator(server, client, keyframe);
+            }
+        } else {
+            for (const SpectateBuffer& buffer : pending) {
+                queueSpectator(server, client, buffer);
+            }
+        }
+        if (!flushSpectator(server, client)) {
+            hungup.push_back(client.fd);
+        }
+    }
+    for (int fd : hungup) {
+        dropSpectator(server, fd);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    server->messages += pending.size();
+    server->fanoutnanos += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+}
+
+void runSpectatorServer(SpectatorServer* server) {
+    epoll_event events[256];
+    char discard[256];
+    while (server->running) {
+        int n = epoll_wait(server->epollfd, events, 256, 100);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == server->listenfd) {
+                int client;
+                while ((client = accept4(server->listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    epoll_event event = {};
+                    event.events = EPOLLIN | EPOLLRDHUP;
+                    event.data.fd = client;
+                    epoll_ctl(server->epollfd, EPOLL_CTL_ADD, client, &event);
+                    server->clients[client].fd = client;
+                }
+                continue;
+            }
+            if (fd == server->wakefd) {
+                uint64_t count;
+                if (read(server->wakefd, &count, sizeof(count)) < 0) {
+                    // nothing to do, it just means someone else already drained it
+                }
+                continue;
+            }
+            auto it = server->clients.find(fd);
+            if (it == server->clients.end()) {
+                continue;
+            }
+            bool hungup = (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0;
+            if (events[i].events & EPOLLIN) {
+                // spectators have nothing to say, but their socket has to be drained to notice when they leave
+                ssize_t got;
+                while ((got = read(fd, discard, sizeof(discard))) > 0) {}
+                if (got == 0) {
+                    hungup = true;
+                }
+            }
+            if (!hungup && (events[i].events & EPOLLOUT)) {
+                hungup = !flushSpectator(server, it->second);
+            }
+            if (hungup) {
+                dropSpectator(server, fd);
+            }
+        }
+        distributeSpectators(server);
+    }
+}
+
+bool startSpectatorServer(SpectatorServer* server, const char* path, const Maze& maze) {
+    server->path = path;
+    server->listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listenfd < 0) {
+        return false;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(server->listenfd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server->listenfd, SOMAXCONN) != 0) {
+        close(server->listenfd);
+        server->listenfd = -1;
+        return false;
+    }
+    server->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    server->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = server->listenfd;
+    epoll_ctl(server->epollfd, EPOLL_CTL_ADD, server->listenfd, &event);
+    event.data.fd = server->wakefd;
+    epoll_ctl(server->epollfd, EPOLL_CTL_ADD, server->wakefd, &event);
+
+    server->layout = maze.layout;
+    server->width = maze.width;
+    server->height = maze.height;
+    server->words = maze.words;
+    server->walls.assign(maze.maze, maze.maze + maze.words);
+    server->explored.assign(maze.explored, maze.explored + maze.words);
+    server->dead.assign(maze.words, 0);
+    if (maze.dead != nullptr) {
+        server->dead.assign(maze.dead, maze.dead + maze.words);
+    }
+    memAlloc(MEM_SPECTATORS, maze.words * 3 * sizeof(uint64_t));
+    initDirty(&server->dirty, maze.words, MEM_SPECTATORS);
+    // a spectator may fall a few keyframes behind before it is resynced
+    server->maxqueue = std::max((size_t)4 << 20, maze.words * 3 * sizeof(uint64_t) * 2);
+
+    server->running = true;
+    server->thread = std::thread(runSpectatorServer, server);
+    return true;
+}
 
-    while (!q.empty()) {
-        Player current = q.front();
-        q.pop();
+void stopSpectatorServer(SpectatorServer* server) {
+    if (!server->running) {
+        return;
+    }
+    server->running = false;
+    server->thread.join();
+    for (auto& it : server->clients) {
+        close(it.first);
+    }
+    server->clients.clear();
+    memFree(MEM_SPECTATORS, server->words * 3 * sizeof(uint64_t));
+    freeDirty(&server->dirty);
+    close(server->listenfd);
+    close(server->epollfd);
+    close(server->wakefd);
+    unlink(server->path.c_str());
+}
 
-        if (current.x == to.x && current.y == to.y) {
-            break;
-        }
+// called by the game loop after every frame. does nothing if nothing changed
+void publishSpectators(SpectatorServer* server, const Maze& maze, Player player, const Navigator* nav) {
+    if (!server->running) {
+        return;
+    }
+    // only the changed blocks are compared, and without the lock since the server thread only reads the shadow planes
+    server->entries.clear();
+    takeDirty(&server->dirty, [&](size_t block) { diffBlock(server->entries, maze, block, server->explored, server->dead); });
+    SpectateBuffer buffer;
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(server->lock);
+        applyEntries(server->entries.data(), server->entries.size(), server->explored, server->dead);
 
-        // right
-        if (current.x < maze->width - 1) {
-            if (!getTileState(*maze, current.x + 1, current.y).wall && parent[current.y * maze->width + current.x + 1] == -1) {
-                q.push({current.x + 1, current.y});
-                parent[current.y * maze->width + current.x + 1] = current.y * maze->width + current.x;
-            }
+        int32_t pathcount = -1;
+        if (maze.navmap != nullptr && (!server->pathshown || nav->generation != server->lastgeneration)) {
+            server->pathcells.assign(nav->pathcells.begin(), nav->pathcells.end());
+            server->pathshown = true;
+            server->lastgeneration = nav->generation;
+            pathcount = server->pathcells.size();
+        } else if (maze.navmap == nullptr && server->pathshown) {
+            server->pathcells.clear();
+            server->pathshown = false;
+            pathcount = 0;
         }
 
-        // left
-        if (current.x > 0) {
-            if (!getTileState(*maze, current.x - 1, current.y).wall && parent[current.y * maze->width + current.x - 1] == -1) {
-                q.push({current.x - 1, current.y});
-                parent[current.y * maze->width + current.x - 1] = current.y * maze->width + current.x;
-            }
+        bool moved = player.x != server->player.x || player.y != server->player.y;
+        if (server->entries.empty() && pathcount == -1 && !moved) {
+            return;
         }
+        server->player = player;
 
-        // down
-        if (current.y < maze->height - 1) {
-            if (!getTileState(*maze, current.x, current.y + 1).wall && parent[(current.y + 1) * maze->width + current.x] == -1) {
-                q.push({current.x, current.y + 1});
-                parent[(current.y + 1) * maze->width + current.x] = current.y * maze->width + current.x;
-            }
-        }
+        size_t entrybytes = server->entries.size() * sizeof(CheckpointEntry);
+        size_t pathbytes = pathcount > 0 ? pathcount * sizeof(uint64_t) : 0;
+        buffer = spectateMessage(SPECTATE_DELTA, sizeof(DeltaHeader) + entrybytes + pathbytes);
+        DeltaHeader header = {player.x, player.y, (uint32_t)server->entries.size(), pathcount};
+        uint8_t* out = buffer->data() + sizeof(SpectateFrame);
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + sizeof(header), server->entries.data(), entrybytes);
+        memcpy(out + sizeof(header) + entrybytes, server->pathcells.data(), pathbytes);
+        // if there was something pending already the server has been woken up and hasn't picked it up yet
+        wake = server->pending.empty();
+        server->pending.push_back(buffer);
+    }
+    uint64_t one = 1;
+    if (wake && write(server->wakefd, &one, sizeof(one)) < 0) {
+        // the counter is already non zero, the server will wake up anyway
+    }
+}
 
-        // up
-        if (current.y > 0) {
-            if (!getTileState(*maze, current.x, current.y - 1).wall && parent[(current.y - 1) * maze->width + current.x] == -1) {
-                q.push({current.x, current.y - 1});
-                parent[(current.y - 1) * maze->width + current.x] = current.y * maze->width + current.x;
-            }
+// hands the blocks that changed in the maze since the last frame to the journal and the spectators, which each take them when they get to it
+void shareDirty(DirtyWords* changed, Journal* journal, SpectatorServer* spectators) {
+    takeDirty(changed, [&](size_t block) {
+        if (!journal->dirty.blocks.empty()) {
+            markBlock(&journal->dirty, block);
+        }
+        if (!spectators->dirty.blocks.empty()) {
+            markBlock(&spectators->dirty, block);
         }
+    });
+}
+
+// connects the given number of local spectators and plays a random walk, to see what broadcasting costs the game loop
+void benchSpectators(int count, Layout layout) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    Maze maze = generateMaze(256, 256, layout, 0, false);
+    Navigator nav;
+    initNavigator(&nav, maze, NavMode::JumpPoint);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/speedmaze-bench-%d.sock", (int)getpid());
+    SpectatorServer server;
+    if (!startSpectatorServer(&server, path, maze)) {
+        printf("Could not listen on %s\n", path);
+        return;
     }
 
-    // now that we have the parent of each tile, we can trace back the path
+    // the spectators just read and throw away everything, from one thread
+    std::atomic<bool> reading{true};
+    std::atomic<uint64_t> received{0};
+    std::vector<int> fds;
+    int readepoll = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < count; i++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            printf("Could only connect %d spectators\n", i);
+            if (fd >= 0) close(fd);
+            break;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(readepoll, EPOLL_CTL_ADD, fd, &event);
+        fds.push_back(fd);
+    }
+    std::thread reader([&]() {
+        epoll_event events[256];
+        std::vector<uint8_t> buffer(1 << 16);
+        while (reading) {
+            int n = epoll_wait(readepoll, events, 256, 10);
+            for (int i = 0; i < n; i++) {
+                ssize_t got;
+                while ((got = read(events[i].data.fd, buffer.data(), buffer.size())) > 0) {
+                    received += got;
+                }
+            }
+        }
+    });
 
-    Player current = to;
+    int ticks = 2000;
+    Player player = {1, 1};
+    // the server is the only one that wants to know what changed
+    maze.dirty = &server.dirty;
+    // the walls never change, so the dead ends only need to be found once
+    deadAnalysis(&maze, player);
+    double publishmicros = 0;
+    double worstmicros = 0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < ticks; i++) {
+        int dir = rand() % 4;
+        Player next = {player.x + (dir == 0) - (dir == 1), player.y + (dir == 2) - (dir == 3)};
+        if (!getBit(maze, maze.maze, next.x, next.y)) {
+            player = next;
+        }
+        exploreMaze(maze, player);
 
-    maze->navmap = new int[maze->width * maze->height / 8];
-    for (int i = 0; i < maze->width * maze->height / 8; i++) {
-        maze->navmap[i] = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        publishSpectators(&server, maze, player, &nav);
+        double micros = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0;
+        publishmicros += micros;
+        worstmicros = std::max(worstmicros, micros);
+        usleep(1000);
     }
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1000000.0;
 
-    while (parent[current.y * maze->width + current.x] != -2) {
-        maze->navmap[(current.y * maze->width + current.x) / 8] |= 1 << ((current.y * maze->width + current.x) % 8);
-        current = {parent[current.y * maze->width + current.x] % maze->width, parent[current.y * maze->width + current.x] / maze->width};
+    stopSpectatorServer(&server);
+    reading = false;
+    reader.join();
+    for (int fd : fds) {
+        close(fd);
     }
+    close(readepoll);
 
-    delete[] parent;
+    printf("%zu spectators, %d ticks in %.2lf s\n", fds.size(), ticks, seconds);
+    printf("publish on the game thread: %.2lf us average, %.2lf us worst\n", publishmicros / ticks, worstmicros);
+    printf("server fan out: %.2lf us per message, %llu resyncs, %llu dropped\n",
+        server.messages ? server.fanoutnanos / 1000.0 / server.messages : 0.0,
+        (unsigned long long)server.resynced, (unsigned long long)server.dropped);
+    printf("received %.2lf MB total\n", received / 1048576.0);
 }
 
+// roughly what a game on a maze this size allocates: the generator, the maze planes, the navigator and the journal's copies
+// the junction graph measures at around 10 bytes per tile of the maze once built, perfect or braided, and more while its vectors grow
+const size_t GRAPH_BYTES_PER_TILE = 16;
 
+size_t sessionBytes(int width, int height, Layout layout, NavMode navalg) {
+    // 2 bits per cell of the generator
+    size_t genbytes = (size_t)((width / 2 - 1 + CELLS_PER_WORD - 1) / CELLS_PER_WORD) * (height / 2 - 1) * sizeof(uint64_t);
+    width = (width / 2) * 2;
+    height = (height / 2) * 2;
+    size_t planebytes = planeWords(layout, width, height) * sizeof(uint64_t);
+    size_t graphbytes = (size_t)width * height * GRAPH_BYTES_PER_TILE;
+    // the grid search arrays are only allocated if the grid is searched, and then the graph is freed once the dead ends are marked
+    size_t navbytes = navalg == NavMode::Junction ? 0 : (size_t)width * height * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(size_t));
+    // walls, explored, dead, the navigator's path and the journal's explored and dead
+    return genbytes + planebytes * 6 + std::max(graphbytes, navbytes);
+}
 
-void deadAnalysis(Maze* maze, Player player) {
-    // if a cell only has 2 directions, and one leads to an empty hallway (or other dead cells), then it is a dead cell
-    if (maze->dead == nullptr) {
-        maze->dead = new int[maze->width * maze->height / 8];
-        for (int i = 0; i < maze->width * maze->height / 8; i++) {
-            maze->dead[i] = 0;
+// an endless maze only keeps ENDLESS_ROWS rows, but it is as wide as asked for
+size_t endlessBytes(int width, Layout layout) {
+    // the set, down, seen and pick of each cell of eller's row
+    size_t ellerbytes = (size_t)std::max(0, width / 2 - 1) * (sizeof(int) * 3 + sizeof(uint8_t));
+    size_t planebytes = planeWords(layout, width, ENDLESS_ROWS) * sizeof(uint64_t);
+    // there is no graph to search, so the grid search arrays are always allocated
+    size_t navbytes = (size_t)width * ENDLESS_ROWS * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(size_t));
+    // walls, explored, dead and the navigator's path
+    return ellerbytes + planebytes * 4 + navbytes;
+}
+
+// physical memory, or the address space limit if that is lower
+size_t availableBytes() {
+    size_t bytes = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_AS, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < bytes) {
+        bytes = limit.rlim_cur;
+    }
+    return bytes;
+}
+
+size_t residentBytes() {
+    long size = 0;
+    long pages = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f != nullptr) {
+        if (fscanf(f, "%ld %ld", &size, &pages) != 2) {
+            pages = 0;
         }
+        fclose(f);
     }
+    return (size_t)pages * sysconf(_SC_PAGESIZE);
+}
 
-    // for each cell, check if it is a dead cell
-    for (int x = 0; x < maze->width; x++) {
-        for (int y = 0; y < maze->height; y++) {
-            if (getTileState(*maze, x, y).wall) {
-                continue;
+// generate and play through the given number of mazes, printing the resident size along the way.
+// if anything leaked the resident size would keep climbing
+void benchMemory(int cycles, Layout layout) {
+    size_t firstrss = 0;
+    for (int i = 0; i < cycles; i++) {
+        {
+            Maze maze = generateMaze(6*8, 6*8, layout, 0.1, false);
+            Navigator nav;
+            initNavigator(&nav, maze, NavMode::JumpPoint);
+            Player player = {1, 1};
+            for (int step = 0; step < 20; step++) {
+                exploreMaze(maze, player);
+                deadAnalysis(&maze, player);
+                Player to = {1 + 2 * (rand() % (maze.width / 2 - 1)), 1 + 2 * (rand() % (maze.height / 2 - 1))};
+                if (getBit(maze, maze.explored, to.x, to.y)) {
+                    navigateMaze(&maze, &nav, player, to);
+                    player = to;
+                }
             }
+        }
+        size_t rss = residentBytes();
+        if (i == 0) {
+            firstrss = rss;
+        }
+        if (i == 0 || (i + 1) % std::max(1, cycles / 10) == 0) {
+            printf("cycle %6d: rss %zu KB (%+ld KB), accounted %zu bytes, peak %zu bytes\n", i + 1, rss / 1024,
+                (long)(rss / 1024) - (long)(firstrss / 1024), memTotalBytes(), memPeakBytes());
+        }
+    }
+    for (int i = 0; i < MEM_LAYERS; i++) {
+        printf("%-10s %zu bytes\n", MEM_LAYER_NAMES[i], memLayerBytes((MemLayer)i));
+    }
+}
 
-            int numempty = 0;
-
-            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
-            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
-            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
-            if (y > 0 && !getTileState(*maze, x, y - 1).wall) numempty++;
-
-            if (numempty == 1) {
-                // this is a dead end
-                maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
+// what a plane costs in each layout for square and long thin mazes, and a check that the accessors working a word at a time
+// (orRect, rowByte and columnByte) agree with setBit and getBit in each. rectangles are set at random and mirrored into a plain bitmap
+void benchLayouts(int steps) {
+    const int sizes[5][2] = {{48, 48}, {1000, 1000}, {100000, 1000}, {1000, 100000}, {30000, 24}};
+    for (int s = 0; s < 5; s++) {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        printf("%dx%d (%zu KB as bits)\n", width, height, ((size_t)width * height + 7) / 8 / 1024);
+        unsigned int seed = rand();
+        for (int l = 0; l < 3; l++) {
+            Layout layout = (Layout)l;
+            Maze maze(width, height, layout);
+            if (maze.storage == nullptr) {
+                printf("  %-8s not enough memory for %zu KB planes\n", layoutName(layout), planeWords(layout, width, height) * sizeof(uint64_t) / 1024);
+                continue;
             }
-            if (numempty == 2) {
-                // if one direction leads to a dead end, then this is also a dead end
-                if (x < maze->width - 1) {
-                    if (!getTileState(*maze, x + 1, y).wall && (maze->dead[(y * maze->width + x + 1) / 8] & (1 << ((y * maze->width + x + 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (x > 0) {
-                    if (!getTileState(*maze, x - 1, y).wall && (maze->dead[(y * maze->width + x - 1) / 8] & (1 << ((y * maze->width + x - 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
+            std::vector<uint64_t> bits(((size_t)width * height + 63) / 64);
+            auto reference = [&](int x, int y) { return (bits[((size_t)y * width + x) / 64] >> (((size_t)y * width + x) % 64)) & 1; };
+            srand(seed);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (int i = 0; i < steps; i++) {
+                int x0 = rand() % width;
+                int y0 = rand() % height;
+                int x1 = std::min(width - 1, x0 + rand() % 20);
+                int y1 = std::min(height - 1, y0 + rand() % 20);
+                if (i % 2 == 0) {
+                    orRect(maze, maze.explored, x0, x1, y0, y1, false);
+                } else {
+                    for (int y = y0; y <= y1; y++) {
+                        setBit(maze, maze.explored, x0, y);
                     }
+                    x1 = x0;
                 }
-                if (y < maze->height - 1) {
-                    if (!getTileState(*maze, x, y + 1).wall && (maze->dead[((y + 1) * maze->width + x) / 8] & (1 << (((y + 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
+                for (int y = y0; y <= y1; y++) {
+                    for (int x = x0; x <= x1; x++) {
+                        bits[((size_t)y * width + x) / 64] |= (uint64_t)1 << (((size_t)y * width + x) % 64);
                     }
                 }
-                if (y > 0) {
-                    if (!getTileState(*maze, x, y - 1).wall && (maze->dead[((y - 1) * maze->width + x) / 8] & (1 << (((y - 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
+            }
+            double millis = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1000.0;
+
+            int wrong = 0;
+            for (int i = 0; i < steps; i++) {
+                int x = rand() % width;
+                int y = rand() % height;
+                wrong += getBit(maze, maze.explored, x, y) != (bool)reference(x, y);
+                // only the tiles inside the maze, past the edge is padding or, row major, the next row
+                uint32_t row = 0;
+                uint32_t column = 0;
+                for (int k = 0; k < 8; k++) {
+                    row |= (x / 8 * 8 + k < width ? reference(x / 8 * 8 + k, y) : 0) << k;
+                    column |= (y / 8 * 8 + k < height ? reference(x, y / 8 * 8 + k) : 0) << k;
                 }
+                uint32_t rowmask = (1u << std::min(8, width - x / 8 * 8)) - 1;
+                uint32_t columnmask = (1u << std::min(8, height - y / 8 * 8)) - 1;
+                wrong += (rowByte(maze, maze.explored, x / 8, y) & rowmask) != row;
+                wrong += (columnByte(maze, maze.explored, x, y / 8) & columnmask) != column;
             }
+            printf("  %-8s %8zu KB per plane, %7.2f ms to set %d rectangles, %d of %d reads wrong\n", layoutName(layout),
+                maze.words * sizeof(uint64_t) / 1024, millis, steps, wrong, steps * 3);
         }
     }
-    for (int x = maze->width - 1; x > 0; x--) {
-        for (int y = 0; y < maze->height; y++) {
-            if (getTileState(*maze, x, y).wall) {
-                continue;
-            }
+}
 
-            int numempty = 0;
+// compare the junction graph against the grid on one fully explored maze: dead end marking and random navigation queries
+void benchGraph(int queries, int width, int height, Layout layout, double braid) {
+    Maze maze = generateMaze(width, height, layout, braid, false);
+    if (maze.storage == nullptr) {
+        printf("Not enough memory for a %dx%d maze\n", width, height);
+        return;
+    }
+    for (int y = 0; y < maze.height; y++) {
+        for (int x = 0; x < maze.width; x++) {
+            setBit(maze, maze.explored, x, y);
+        }
+    }
 
-            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
-            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
-            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
-            if (y > 0 && !getTileState(*maze, x, y - 1).wall) numempty++;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    JunctionGraph graph;
+    buildJunctionGraph(&graph, maze);
+    std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+    markGraphDead(graph, &maze);
+    std::chrono::steady_clock::time_point marked = std::chrono::steady_clock::now();
+    size_t graphdead = countBits(maze, maze.dead);
+    std::fill(maze.dead, maze.dead + maze.words, 0);
+    deadAnalysis(&maze, {1, 1});
+    std::chrono::steady_clock::time_point swept = std::chrono::steady_clock::now();
+    printf("%dx%d %s: %zu open tiles, %zu nodes, %zu edges (%.1f tiles per node), %zu bytes\n", maze.width, maze.height, layoutName(layout),
+        (size_t)graph.tiles, graph.nodecell.size(), graph.edges.size(), (double)graph.tiles / std::max<size_t>(1, graph.nodecell.size()), graph.accounted);
+    printf("build %.2f ms, dead ends on the graph %.2f ms (%zu dead), one grid sweep %.2f ms (%zu dead)\n",
+        std::chrono::duration_cast<std::chrono::microseconds>(built - begin).count() / 1000.0,
+        std::chrono::duration_cast<std::chrono::microseconds>(marked - built).count() / 1000.0, graphdead,
+        std::chrono::duration_cast<std::chrono::microseconds>(swept - marked).count() / 1000.0, countBits(maze, maze.dead));
 
-            if (numempty == 1) {
-                // this is a dead end
-                maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-            }
-            if (numempty == 2) {
-                // if one direction leads to a dead end, then this is also a dead end
-                if (x < maze->width - 1) {
-                    if (!getTileState(*maze, x + 1, y).wall && (maze->dead[(y * maze->width + x + 1) / 8] & (1 << ((y * maze->width + x + 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (x > 0) {
-                    if (!getTileState(*maze, x - 1, y).wall && (maze->dead[(y * maze->width + x - 1) / 8] & (1 << ((y * maze->width + x - 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (y < maze->height - 1) {
-                    if (!getTileState(*maze, x, y + 1).wall && (maze->dead[((y + 1) * maze->width + x) / 8] & (1 << (((y + 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (y > 0) {
-                    if (!getTileState(*maze, x, y - 1).wall && (maze->dead[((y - 1) * maze->width + x) / 8] & (1 << (((y - 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-            }
+    NavMode modes[3] = {NavMode::AStar, NavMode::JumpPoint, NavMode::Junction};
+    Navigator navs[3];
+    for (int m = 0; m < 3; m++) {
+        initNavigator(&navs[m], maze, modes[m]);
+        navs[m].graph = &graph;
+    }
+    double seconds[3] = {0, 0, 0};
+    size_t expanded[3] = {0, 0, 0};
+    int mismatches = 0;
+    for (int q = 0; q < queries; q++) {
+        Player from = {1 + 2 * (rand() % (maze.width / 2 - 1)), 1 + 2 * (rand() % (maze.height / 2 - 1))};
+        Player to = {1 + 2 * (rand() % (maze.width / 2 - 1)), 1 + 2 * (rand() % (maze.height / 2 - 1))};
+        size_t lengths[3];
+        for (int m = 0; m < 3; m++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            navigateMaze(&maze, &navs[m], from, to);
+            seconds[m] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e9;
+            expanded[m] += navs[m].expanded;
+            lengths[m] = navs[m].pathcells.size();
         }
+        mismatches += lengths[0] != lengths[1] || lengths[0] != lengths[2];
     }
-    for (int x = 0; x < maze->width; x++) {
-        for (int y = maze->height - 1; y > 0; y--) {
-            if (getTileState(*maze, x, y).wall) {
-                continue;
-            }
-
-            int numempty = 0;
+    for (int m = 0; m < 3; m++) {
+        printf("%-6s %8.2f us per query, %10.1f nodes expanded per query\n", navModeName(modes[m]), seconds[m] * 1e6 / queries, (double)expanded[m] / queries);
+    }
+    printf("%d of %d path lengths differ\n", mismatches, queries);
 
-            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
-            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
-            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
-            if (y > 0 && !getTileState(*maze, x, y - 1).wall) numempty++;
+    // which corridor a tile is on is checked by walking that corridor, the branch behind it by flood filling the grid.
+    // branch sizes are measured on a spanning tree, which is only the maze itself when it isn't braided
+    if (graph.tiles == graph.nodecell.size()) {
+        return;
+    }
+    buildGraphTree(&graph);
+    double corridorseconds = 0;
+    double branchseconds = 0;
+    int corridorwrong = 0;
+    int branchwrong = 0;
+    int branchchecks = braid > 0 ? 0 : std::min(queries, 100);
+    std::vector<uint8_t> filled;
+    std::vector<Player> stack;
+    for (int q = 0; q < queries; q++) {
+        Player tile;
+        do {
+            tile = {rand() % maze.width, rand() % maze.height};
+        } while (!tileOpen(maze, tile.x, tile.y) || openNeighbors(maze, tile.x, tile.y) != 2);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint32_t e = graphCorridor(graph, maze, tile.x, tile.y);
+        std::chrono::steady_clock::time_point found = std::chrono::steady_clock::now();
+        corridorseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(found - start).count() / 1e9;
+        if (e == NO_EDGE) {
+            corridorwrong++;
+            continue;
+        }
+        const JunctionEdge& edge = graph.edges[e];
+        uint32_t node = rand() % 2 ? edge.a : edge.b;
+        start = std::chrono::steady_clock::now();
+        uint64_t branch = graphBranchTiles(graph, node, e);
+        branchseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e9;
 
-            if (numempty == 1) {
-                // this is a dead end
-                maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-            }
-            if (numempty == 2) {
-                // if one direction leads to a dead end, then this is also a dead end
-                if (x < maze->width - 1) {
-                    if (!getTileState(*maze, x + 1, y).wall && (maze->dead[(y * maze->width + x + 1) / 8] & (1 << ((y * maze->width + x + 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (x > 0) {
-                    if (!getTileState(*maze, x - 1, y).wall && (maze->dead[(y * maze->width + x - 1) / 8] & (1 << ((y * maze->width + x - 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (y < maze->height - 1) {
-                    if (!getTileState(*maze, x, y + 1).wall && (maze->dead[((y + 1) * maze->width + x) / 8] & (1 << (((y + 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (y > 0) {
-                    if (!getTileState(*maze, x, y - 1).wall && (maze->dead[((y - 1) * maze->width + x) / 8] & (1 << (((y - 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
+        Player a = graphNodeTile(graph, maze, edge.a);
+        corridorwrong += !walkCorridor(maze, a.x, a.y, edge.dira, tile).stopped;
+        if (q >= branchchecks) {
+            continue;
+        }
+        filled.assign((size_t)maze.width * maze.height, 0);
+        Player from = graphNodeTile(graph, maze, node);
+        filled[navCell(maze, from.x, from.y)] = 1;
+        int dir = graphLeave(edge, node);
+        stack.assign(1, {from.x + GRAPH_DIRS[dir][0], from.y + GRAPH_DIRS[dir][1]});
+        filled[navCell(maze, stack[0].x, stack[0].y)] = 1;
+        uint64_t count = 0;
+        while (!stack.empty()) {
+            Player p = stack.back();
+            stack.pop_back();
+            count++;
+            for (int d = 0; d < 4; d++) {
+                Player next = {p.x + GRAPH_DIRS[d][0], p.y + GRAPH_DIRS[d][1]};
+                if (tileOpen(maze, next.x, next.y) && !filled[navCell(maze, next.x, next.y)]) {
+                    filled[navCell(maze, next.x, next.y)] = 1;
+                    stack.push_back(next);
                 }
             }
         }
+        branchwrong += count != branch;
     }
-    for (int x = maze->width-1; x > 0; x--) {
-        for (int y = maze->height-1; y > 0; y--) {
-            if (getTileState(*maze, x, y).wall) {
-                continue;
+    printf("corridor %.2f us per query, %d of %d wrong. branch size %.2f us per query, %d wrong of %d checked with a flood fill\n",
+        corridorseconds * 1e6 / queries, corridorwrong, queries, branchseconds * 1e6 / queries, branchwrong, branchchecks);
+}
+
+// time one tick of exploration for many bots: batched on one thread, batched on the pool, and each bot raycasting on its own
+void benchBots(int count, int width, int height, Layout layout) {
+    Maze maze = generateMaze(width, height, layout, 0, false);
+    if (maze.storage == nullptr) {
+        printf("Not enough memory for a %dx%d maze\n", width, height);
+        return;
+    }
+    size_t planebytes = maze.words * sizeof(uint64_t);
+    std::vector<uint64_t> batched(maze.words);
+    const int ticks = 50;
+    const char* names[3] = {"batched, 1 thread", "batched, pool", "per bot"};
+    double seconds[3] = {0, 0, 0};
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int seed = rand();
+    for (int m = 0; m < 3; m++) {
+        AgentBatch batch;
+        srand(seed);
+        initAgents(&batch, maze, count, m == 1 ? threads : 1);
+        srand(seed);
+        memset(maze.explored, 0, planebytes);
+        for (int tick = 0; tick < ticks; tick++) {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            if (m == 2) {
+                // without following dead ends, so this is just the raycasts
+                for (const Agent& agent : batch.agents) {
+                    exploreMaze(maze, agent.pos, false);
+                }
+            } else {
+                exploreAgents(&batch, maze);
             }
+            seconds[m] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count() / 1e9;
+            moveAgents(&batch, maze);
+        }
+        if (m == 0) {
+            memcpy(batched.data(), maze.explored, planebytes);
+        }
+        printf("%-18s %9.3f ms per tick, %5.2f%% explored\n", names[m], seconds[m] * 1000 / ticks,
+            countBits(maze, maze.explored) / ((double)(maze.width - 1) * (maze.height - 1)) * 100);
+        if (memcmp(batched.data(), maze.explored, planebytes) != 0) {
+            printf("explored plane differs from the first run\n");
+        }
+    }
+    printf("%d bots, %d threads in the pool\n", count, threads);
+}
 
-            int numempty = 0;
+// append that many made up results to a scratch log, looking each one up the way the end of a game does,
+// then check the lookups against scanning the whole log
+void benchResults(int count) {
+    const ResultFiles files = {"bench-results.log", "bench-results.idx"};
+    remove(files.log);
+    remove(files.index);
+    const int sizes[4][2] = {{48, 48}, {64, 32}, {100, 100}, {1000, 1000}};
+    double appendseconds = 0;
+    double lookupseconds = 0;
+    double slowestlookup = 0;
+    double mergeseconds = 0;
+    double slowestmerge = 0;
+    for (int i = 0; i < count; i++) {
+        const int* size = sizes[rand() % 4];
+        ResultRecord record = {};
+        record.timestamp = time(NULL);
+        record.seed = rand();
+        record.width = size[0];
+        record.height = size[1];
+        record.braid = rand() % 2 * 0.5;
+        record.time = size[0] * size[1] / 100.0 * (0.5 + rand() / (double)RAND_MAX);
+        record.moves = rand() % 10000;
+        record.teleports = rand() % 100;
+        record.curve = hashCurve(CURVE_SEED, i);
 
-            if (x < maze->width - 1 && !getTileState(*maze, x + 1, y).wall) numempty++;
-            if (x > 0 && !getTileState(*maze, x - 1, y).wall) numempty++;
-            if (y < maze->height - 1 && !getTileState(*maze, x, y + 1).wall) numempty++;
-            if (y > 0 && !getTileState(*maze, x, y - 1).wall) numempty++;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        appendResult(files, record);
+        std::chrono::steady_clock::time_point appended = std::chrono::steady_clock::now();
+        lookupResults(files, record.width, record.height, record.braid, record.time);
+        std::chrono::steady_clock::time_point looked = std::chrono::steady_clock::now();
+        mergeResultIndex(files, false);
+        std::chrono::steady_clock::time_point merged = std::chrono::steady_clock::now();
 
-            if (numempty == 1) {
-                // this is a dead end
-                maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-            }
-            if (numempty == 2) {
-                // if one direction leads to a dead end, then this is also a dead end
-                if (x < maze->width - 1) {
-                    if (!getTileState(*maze, x + 1, y).wall && (maze->dead[(y * maze->width + x + 1) / 8] & (1 << ((y * maze->width + x + 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (x > 0) {
-                    if (!getTileState(*maze, x - 1, y).wall && (maze->dead[(y * maze->width + x - 1) / 8] & (1 << ((y * maze->width + x - 1) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (y < maze->height - 1) {
-                    if (!getTileState(*maze, x, y + 1).wall && (maze->dead[((y + 1) * maze->width + x) / 8] & (1 << (((y + 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
-                if (y > 0) {
-                    if (!getTileState(*maze, x, y - 1).wall && (maze->dead[((y - 1) * maze->width + x) / 8] & (1 << (((y - 1) * maze->width + x) % 8)))) {
-                        maze->dead[(y * maze->width + x) / 8] |= 1 << ((y * maze->width + x) % 8);
-                    }
-                }
+        appendseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(appended - begin).count() / 1e9;
+        double lookup = std::chrono::duration_cast<std::chrono::nanoseconds>(looked - appended).count() / 1e9;
+        double merge = std::chrono::duration_cast<std::chrono::nanoseconds>(merged - looked).count() / 1e9;
+        lookupseconds += lookup;
+        slowestlookup = std::max(slowestlookup, lookup);
+        mergeseconds += merge;
+        slowestmerge = std::max(slowestmerge, merge);
+    }
+    printf("%d results: append %.2f us, lookup %.2f us (slowest %.2f us), merging %.2f us per result (slowest merge %.2f ms)\n", count,
+        appendseconds * 1e6 / count, lookupseconds * 1e6 / count, slowestlookup * 1e6, mergeseconds * 1e6 / count, slowestmerge * 1e3);
+
+    // the slow way, reading every record
+    int mismatches = 0;
+    FILE* f = fopen(files.log, "rb");
+    std::vector<ResultRecord> records;
+    ResultRecord record;
+    while (f != nullptr && fread(&record, sizeof(record), 1, f) == 1) {
+        records.push_back(record);
+    }
+    if (f != nullptr) {
+        fclose(f);
+    }
+    for (int q = 0; q < 1000; q++) {
+        const int* size = sizes[q % 4];
+        double braid = q / 4 % 2 * 0.5;
+        double time = size[0] * size[1] / 100.0 * rand() / (double)RAND_MAX * 1.6;
+        ResultStats expected = {0, 0, HUGE_VAL};
+        for (const ResultRecord& r : records) {
+            if (r.width == size[0] && r.height == size[1] && r.braid == braid) {
+                expected.runs++;
+                expected.faster += r.time < time;
+                expected.best = std::min(expected.best, r.time);
             }
         }
+        ResultStats stats = lookupResults(files, size[0], size[1], braid, time);
+        mismatches += stats.runs != expected.runs || stats.faster != expected.faster || stats.best != expected.best;
     }
+    printf("%d of 1000 lookups differ from a full scan\n", mismatches);
+    remove(files.log);
+    remove(files.index);
 }
 
-int main() {
+int main(int argc, char** argv) {
     setlocale(LC_ALL, "");
     _log_file = fopen("out.txt", "w+");
 
+    Layout layout = Layout::RowMajor;
+    NavMode navalg = NavMode::Junction;
+    double braid = 0;
+    bool resume = false;
+    const char* spectate = nullptr;
+    int benchspectators = 0;
+    int benchmemory = 0;
+    int benchgraph = 0;
+    int benchlayouts = 0;
+    int benchbots = 0;
+    int bots = 0;
+    const char* exportpath = nullptr;
+    int scale = 1;
+    bool leaderboard = false;
+    int benchresults = 0;
+    int width = 6*8;
+    int height = 6*8;
+    unsigned int seed = time(NULL);
+    bool endless = false;
+    bool animate = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rowmajor") == 0) {
+                layout = Layout::RowMajor;
+            } else if (strcmp(argv[i], "tiled") == 0) {
+                layout = Layout::Tiled;
+            } else if (strcmp(argv[i], "morton") == 0) {
+                layout = Layout::Morton;
+            } else {
+                printf("Unknown layout %s, expected rowmajor, tiled or morton\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--nav") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "astar") == 0) {
+                navalg = NavMode::AStar;
+            } else if (strcmp(argv[i], "jps") == 0) {
+                navalg = NavMode::JumpPoint;
+            } else if (strcmp(argv[i], "graph") == 0) {
+                navalg = NavMode::Junction;
+            } else {
+                printf("Unknown navigation %s, expected astar, jps or graph\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--braid") == 0 && i + 1 < argc) {
+            braid = atof(argv[++i]);
+            if (braid < 0 || braid > 1) {
+                printf("Braid must be between 0 and 1, got %s\n", argv[i]);
+                return 1;
+            }
+        } else if ((strcmp(argv[i], "--width") == 0 || strcmp(argv[i], "--height") == 0) && i + 1 < argc) {
+            long side = strtol(argv[i + 1], nullptr, 10);
+            if (side < MIN_MAZE_SIDE || side > MAX_MAZE_SIDE) {
+                printf("%s must be between %d and %d, got %s\n", argv[i] + 2, MIN_MAZE_SIDE, MAX_MAZE_SIDE, argv[i + 1]);
+                return 1;
+            }
+            if (argv[i][2] == 'w') {
+                width = side;
+            } else {
+                height = side;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = true;
+        } else if (strcmp(argv[i], "--endless") == 0) {
+            endless = true;
+        } else if (strcmp(argv[i], "--no-animate") == 0) {
+            animate = false;
+        } else if (strcmp(argv[i], "--spectate") == 0 && i + 1 < argc) {
+            spectate = argv[++i];
+        } else if (strcmp(argv[i], "--bench-spectators") == 0 && i + 1 < argc) {
+            benchspectators = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-memory") == 0 && i + 1 < argc) {
+            benchmemory = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-graph") == 0 && i + 1 < argc) {
+            benchgraph = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bots") == 0 && i + 1 < argc) {
+            bots = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-layouts") == 0 && i + 1 < argc) {
+            benchlayouts = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-bots") == 0 && i + 1 < argc) {
+            benchbots = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            exportpath = argv[++i];
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--leaderboard") == 0) {
+            leaderboard = true;
+        } else if (strcmp(argv[i], "--bench-results") == 0 && i + 1 < argc) {
+            benchresults = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [--width n] [--height n] [--seed n] [--layout rowmajor|tiled|morton] [--nav astar|jps|graph] [--braid 0..1] [--resume] [--endless] [--no-animate] [--bots n] [--spectate socket] [--bench-spectators count] [--bench-memory cycles] [--bench-graph queries] [--bench-layouts n] [--bench-bots n] [--export file] [--scale n] [--leaderboard] [--bench-results n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (benchspectators > 0) {
+        benchSpectators(benchspectators, layout);
+        return 0;
+    }
+    if (benchmemory > 0) {
+        benchMemory(benchmemory, layout);
+        return 0;
+    }
+    if (benchlayouts > 0) {
+        srand(seed);
+        benchLayouts(benchlayouts);
+        return 0;
+    }
+    if (benchgraph > 0) {
+        srand(seed);
+        benchGraph(benchgraph, width, height, layout, braid);
+        return 0;
+    }
+    if (benchbots > 0) {
+        srand(seed);
+        benchBots(benchbots, width, height, layout);
+        return 0;
+    }
+    if (benchresults > 0) {
+        srand(seed);
+        benchResults(benchresults);
+        return 0;
+    }
+    if (leaderboard) {
+        // mazes are always an even number of tiles, the same rounding generateMaze does
+        printLeaderboard(RESULT_FILES, width / 2 * 2, height / 2 * 2, braid, 10);
+        return 0;
+    }
+
+    if (exportpath != nullptr) {
+        // draw the maze instead of playing it. a resumed session shows what was explored so far, a new maze is shown whole.
+        // only the maze itself has to fit in memory, not a whole session, so this comes before that check
+        srand(seed);
+        Maze maze;
+        Journal journal;
+        Player player;
+        double elapsed = 0;
+        if (resume && resumeJournal(&journal, &maze, &player, &elapsed)) {
+            endJournal(&journal, false);
+        } else {
+            maze = generateMaze(width, height, layout, braid, false);
+            if (maze.storage == nullptr) {
+                printf("Not enough memory for a %dx%d maze\n", width, height);
+                return 1;
+            }
+            std::fill(maze.explored, maze.explored + maze.words, ~(uint64_t)0);
+        }
+        size_t rss = residentBytes();
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        bool ok = exportMaze(maze, exportpath, scale);
+        double millis = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1000.0;
+        if (!ok) {
+            printf("Could not write %s\n", exportpath);
+            return 1;
+        }
+        printf("Exported a %dx%d maze to %s in %lf ms, resident size went from %zu KB to %zu KB\n", maze.width, maze.height, exportpath, millis, rss / 1024, residentBytes() / 1024);
+        return 0;
+    }
+
+    // fail here rather than halfway through allocating with curses already up. a resumed session is as big as the saved one
+    {
+        int needwidth = width;
+        int needheight = height;
+        size_t needed = 0;
+        SnapHeader saved;
+        if (endless) {
+            needheight = ENDLESS_ROWS;
+            needed = endlessBytes(width, layout);
+        } else if (resume && peekSession(&saved)) {
+            needwidth = saved.width;
+            needheight = saved.height;
+            needed = sessionBytes(saved.width, saved.height, (Layout)saved.layout, navalg);
+        } else {
+            needed = sessionBytes(width, height, layout, navalg);
+        }
+        size_t available = availableBytes();
+        if (needed > available) {
+            printf("A %dx%d maze needs about %zu MB, but only %zu MB of memory is available\n", needwidth, needheight, needed >> 20, available >> 20);
+            return 1;
+        }
+    }
+
     LOG("STARTING\n");
-    srand(time(NULL));
+    LOG("Seed %u, %dx%d maze\n", seed, width, height);
+    srand(seed);
     initscr();
     noecho();
     cbreak();
@@ -736,6 +4505,7 @@ int main() {
     init_pair(3, COLOR_MAGENTA, COLOR_BLACK);
     init_pair(4, COLOR_RED, COLOR_BLACK);
     init_pair(5, COLOR_BLUE, COLOR_BLACK);
+    init_pair(6, COLOR_CYAN, COLOR_BLACK);
     bkgd(COLOR_PAIR(1));
 
 
@@ -743,30 +4513,106 @@ int main() {
 
     Player old_player = {0, 0};
 
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    Maze maze = generateMaze(6*8, 6*8);
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    double millis = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0;
-    LOG("Took %lf ms to generate maze\n", millis);
+    DirtyWords changed;
+    Maze maze;
+    Journal journal;
+    EllerState eller;
+    double resumed = 0;
+    bool resumedsession = false;
+    if (endless) {
+        // endless runs have no end to resume from or to show spectators
+        maze = generateEndless(&eller, width, layout);
+        if (maze.storage == nullptr) {
+            endwin();
+            printf("Not enough memory for a %d wide endless maze\n", width);
+            return 1;
+        }
+        advanceEndless(&eller, &maze, player.y + ENDLESS_LOOKAHEAD);
+        spectate = nullptr;
+        bots = 0;
+    } else if (resume && resumeJournal(&journal, &maze, &player, &resumed)) {
+        LOG("Resumed session at %lf seconds\n", resumed);
+        resumedsession = true;
+        // the result is for the saved maze, not whatever the command line asked for
+        seed = journal.seed;
+        braid = journal.braid;
+    } else {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        maze = generateMaze(width, height, layout, braid, animate);
+        if (maze.storage == nullptr) {
+            endwin();
+            printf("Not enough memory for a %dx%d maze\n", width, height);
+            return 1;
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        double millis = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0;
+        LOG("Took %lf ms to generate maze (%s layout)\n", millis, layoutName(layout));
+        startJournal(&journal, maze, player, seed, braid);
+    }
 
     Camera cam = {0, 0};
 
-    float percentageexplored = 0;
+    if (!endless) {
+        // from here on the journal and the spectators only look at what changed
+        initDirty(&changed, maze.words, MEM_JOURNAL);
+        maze.dirty = &changed;
+    }
+
+    // the walls of a normal maze never change, so its dead ends are found once on the junction graph
+    JunctionGraph graph;
+    bool deadmarked = false;
+    if (!endless && buildJunctionGraph(&graph, maze)) {
+        markGraphDead(graph, &maze);
+        deadmarked = true;
+        if (navalg != NavMode::Junction) {
+            // the other navigators search the grid, so the graph isn't kept around next to the grid search arrays
+            freeJunctionGraph(&graph);
+        }
+    }
+
+    Navigator nav;
+    initNavigator(&nav, maze, navalg);
+    nav.graph = endless ? nullptr : &graph;
+
+    SpectatorServer spectators;
+    if (spectate != nullptr && !startSpectatorServer(&spectators, spectate, maze)) {
+        LOG("Could not start spectator server on %s\n", spectate);
+    }
+
+    AgentBatch agents;
+    if (bots > 0) {
+        initAgents(&agents, maze, bots, std::thread::hardware_concurrency());
+        exploreAgents(&agents, maze);
+    }
+    std::chrono::steady_clock::time_point lastbottick = std::chrono::steady_clock::now();
+
+    ImageExport image;
+
+    double percentageexplored = 0;
+    bool journalfailed = false; // a checkpoint couldn't be written, so the journal stopped there
 
     exploreMaze(maze, player);
     displayMaze(maze, player, &cam);
+    displayAgents(agents, maze, cam);
     refresh();
 
     bool navmode = false;
 
     // nav should dissapear after 2 seconds
-    std::chrono::steady_clock::time_point startgame = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point startgame = std::chrono::steady_clock::now() - std::chrono::microseconds((long long)(resumed * 1000000));
+    std::chrono::steady_clock::time_point lastcheckpoint = std::chrono::steady_clock::now();
 
     std::chrono::steady_clock::time_point navstart = std::chrono::steady_clock::now();
     bool navdisplay = false;
 
     bool didwin = false;
 
+    // what goes into the results log
+    uint64_t moves = 0;
+    uint64_t teleports = 0;
+    uint64_t curve = CURVE_SEED;
+    uint64_t lastexplored = 0;
+
     int ch;
     while ((ch = getch()) != 'q') {
         if (!navdisplay && maze.navmap != nullptr) {
@@ -775,13 +4621,15 @@ int main() {
         }
         if (navdisplay && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - navstart).count() > 500) {
             navdisplay = false;
-            delete[] maze.navmap;
             maze.navmap = nullptr;
         }
 
+        Player before = navmode ? old_player : player;
+        bool wasnavmode = navmode;
+
         switch (ch) {
             case KEY_UP:
-                if (player.y > 0) {
+                if (player.y > maze.top) {
                     player.y--;
                 }
                 if (!navmode && getPlayerTileState(maze, player).wall) {
@@ -817,18 +4665,25 @@ int main() {
                 if (navmode) {
                     old_player = player;
                 } else {
-                    // now that we have selected a nav location, use an algorithm to find the shortest (only, since it is a perfect maze) path to the location
-                    navigateMaze(&maze, old_player, player);
+                    // now that we have selected a nav location, find the shortest path to it through the explored part of the maze
+                    navigateMaze(&maze, &nav, old_player, player);
                     player = old_player;
                 }
                 break;
+            case 'p':
+                // endless mazes move their rows around under the exporter, so only normal mazes are saved
+                if (!endless && !startExport(&image, maze, EXPORT_FILE, scale)) {
+                    LOG("Still exporting, not starting another one\n");
+                }
+                break;
             case 'e':
             case 't':
                 // if in navmode, we can press t instead of n, to teleport instead of navigate
                 if (navmode) {
                     if (!getPlayerTileState(maze, player).wall && getPlayerTileState(maze, player).explored) {
-                        navigateMaze(&maze, old_player, player);
+                        navigateMaze(&maze, &nav, old_player, player);
                         old_player = player;
+                        teleports++;
                     } else {
                         player = old_player;
                     }
@@ -840,8 +4695,10 @@ int main() {
                 break;
             case 'c':
                 // explore everywhere instantly
-                for (int i = 0; i < maze.width * maze.height / 8; i++) {
-                    maze.explored[i] = 0xFF;
+                for (int y = maze.top; y < maze.height; y++) {
+                    for (int x = 0; x < maze.width; x++) {
+                        setBit(maze, maze.explored, x, y);
+                    }
                 }
                 break;
 
@@ -849,7 +4706,7 @@ int main() {
             // we do need to do a bit more collision checking
             case 'w':
             case 'k':
-                if (player.y > 1) {
+                if (player.y > maze.top + 1) {
                     player.y -= 2;
                 }
                 if (!navmode && (getPlayerTileState(maze, player).wall || getPlayerTileState(maze, {player.x, player.y + 1}).wall)) {
@@ -887,7 +4744,23 @@ int main() {
 
         }
 
-        deadAnalysis(&maze, player);
+        if (!wasnavmode && !navmode && (player.x != before.x || player.y != before.y)) {
+            moves++;
+        }
+
+        if (endless) {
+            advanceEndless(&eller, &maze, (navmode ? old_player : player).y + ENDLESS_LOOKAHEAD);
+        }
+
+        if (!deadmarked) {
+            deadAnalysis(&maze, player);
+        }
+
+        if (bots > 0 && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastbottick).count() >= BOT_TICK_MS) {
+            lastbottick = std::chrono::steady_clock::now();
+            moveAgents(&agents, maze);
+            exploreAgents(&agents, maze);
+        }
 
         if (navmode) {
             displayMaze(maze, old_player, &cam, player);
@@ -895,36 +4768,49 @@ int main() {
             exploreMaze(maze, player);
             displayMaze(maze, player, &cam);
         }
-        percentageexplored = 0;
-        for (int i = 0; i < maze.width * maze.height; i++) {
-            if (maze.explored[i / 8] & (1 << (i % 8))) {
-                percentageexplored++;
+        displayAgents(agents, maze, cam);
+        if (endless) {
+            // there is nothing to finish, so just show how far down the player got
+            mvprintw(LINES - 1, 0, "Depth: %d", (navmode ? old_player : player).y / 2);
+        } else {
+            uint64_t explored = countBits(maze, maze.explored);
+            if (explored != lastexplored) {
+                curve = hashCurve(hashCurve(curve, moves), explored);
+                lastexplored = explored;
             }
-        }
-        percentageexplored = percentageexplored / ((maze.width-1) * (maze.height-1)) * 100;
-        if (percentageexplored == 100) {
-            didwin = true;
-            break;
-        }
-
-        double precentagedead = 0;
-        for (int i = 0; i < maze.width * maze.height; i++) {
-            if (maze.dead[i / 8] & (1 << (i % 8))) {
-                precentagedead++;
+            percentageexplored = explored / ((double)(maze.width-1) * (maze.height-1)) * 100;
+            if (percentageexplored == 100) {
+                didwin = true;
+                break;
             }
-        }
 
-        precentagedead = precentagedead / ((maze.width-1) * (maze.height-1)) * 100;
+            double precentagedead = countBits(maze, maze.dead);
+
+            precentagedead = precentagedead / ((double)(maze.width-1) * (maze.height-1)) * 100;
 
-        mvprintw(LINES - 2, 0, "Dead: %3.2f%%", precentagedead);
+            mvprintw(LINES - 2, 0, "Dead: %3.2f%%", precentagedead);
 
-        // print Explored: %3.2f%% at the bottom of the screen
-        mvprintw(LINES - 1, 0, "Explored: %3.2f%%", percentageexplored);
+            // print Explored: %3.2f%% at the bottom of the screen
+            mvprintw(LINES - 1, 0, "Explored: %3.2f%%", percentageexplored);
+            if (bots > 0) {
+                mvprintw(LINES - 2, 20, "Bots found: %3.2f%%", agentsDiscovered(agents) / ((double)(maze.width-1) * (maze.height-1)) * 100);
+            }
+        }
 
         std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
         double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - startgame).count() / 1000000.0;
         mvprintw(LINES - 1, 20, "Time: %3.2f", elapsed);
 
+        shareDirty(&changed, &journal, &spectators);
+        publishSpectators(&spectators, maze, navmode ? old_player : player, &nav);
+
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastcheckpoint).count() > 1000) {
+            lastcheckpoint = now;
+            if (!checkpointJournal(&journal, maze, navmode ? old_player : player, elapsed)) {
+                journalfailed = true;
+            }
+        }
+
         if (percentageexplored > 100) {
             // display to the user that this round is disqualified
             mvprintw(LINES - 1, 40, "DISQUALIFIED");
@@ -933,28 +4819,54 @@ int main() {
     }
     std::chrono::steady_clock::time_point endgame = std::chrono::steady_clock::now();
 
+    if (!didwin) {
+        shareDirty(&changed, &journal, &spectators);
+        if (!checkpointJournal(&journal, maze, navmode ? old_player : player, std::chrono::duration_cast<std::chrono::microseconds>(endgame - startgame).count() / 1000000.0)) {
+            journalfailed = true;
+        }
+    }
+    finishExport(&image);
+    endJournal(&journal, didwin);
+    stopSpectatorServer(&spectators);
+    logMemStats();
+    for (size_t i = 0; i < agents.agents.size(); i++) {
+        LOG("Bot %zu found %lu tiles\n", i, (unsigned long)agents.agents[i].discovered);
+    }
+
     endwin();
-    if (didwin) {
+    if (journalfailed && !didwin) {
+        printf("Could not write %s, the session can only be resumed from before that\n", SESSION_LOG);
+    }
+    if (didwin && bots > 0) {
+        // the bots did part of the work, so this doesn't count as a record
+        printf("Took %lf (with %d bots)\n", std::chrono::duration_cast<std::chrono::microseconds>(endgame - startgame).count() / 1000000.0, bots);
+    } else if (didwin) {
         printf("Took %lf\n", std::chrono::duration_cast<std::chrono::microseconds>(endgame - startgame).count() / 1000000.0);
         double cur = std::chrono::duration_cast<std::chrono::microseconds>(endgame - startgame).count() / 1000000.0;
-        FILE* f = fopen("record.txt", "r");
-        if (f == nullptr) {
+        ResultRecord result = {};
+        result.timestamp = time(NULL);
+        result.seed = seed;
+        result.flags = resumedsession ? RESULT_RESUMED : 0;
+        result.width = maze.width;
+        result.height = maze.height;
+        result.braid = braid;
+        result.time = cur;
+        result.moves = moves;
+        result.teleports = teleports;
+        result.curve = curve;
+        // looked up before this run is added, so a record is a time faster than every earlier one
+        ResultStats stats = lookupResults(RESULT_FILES, maze.width, maze.height, braid, cur);
+        if (!appendResult(RESULT_FILES, result)) {
+            printf("Could not save the result to %s\n", RESULT_FILES.log);
+        }
+        if (stats.runs == 0 || cur < stats.best) {
             printf("New Record!\n");
-
         } else {
-            double record;
-            fscanf(f, "%lf", &record);
-            fclose(f);
-            if (cur < record) {
-                printf("New Record!\n");
-            } else {
-                printf("Record: %lf\n", record);
-                return 0;
-            }
+            printf("Record: %lf\n", stats.best);
         }
-        f = fopen("record.txt", "w");
-        fprintf(f, "%lf", cur);
-        fclose(f);
+        printf("Ranked %lu of %lu runs of a %dx%d maze (top %.1lf%%)\n", (unsigned long)stats.faster + 1, (unsigned long)stats.runs + 1,
+            maze.width, maze.height, 100.0 * (stats.faster + 1) / (stats.runs + 1));
+        mergeResultIndex(RESULT_FILES, false);
     }
 
     return 0;